@@ -1,6 +1,7 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stdio.h>
 
 #define PROGRAM_VERSION "1.7"
 
@@ -9,6 +10,7 @@ typedef enum OutFmt {
     csv = 1,
     html = 2,
     text = 3,
+    json = 4,
 } OutFmt;
 
 typedef enum VidRes {
@@ -35,6 +37,26 @@ typedef enum Units {
     metric = 2,
 } Units;
 
+typedef enum SortFld {
+    sortContributor = 1,
+    sortCountry = 2,
+    sortDistance = 3,
+    sortDuration = 4,
+    sortElevation = 5,
+    sortProvince = 6,
+    sortTitle = 7,
+    sortToughness = 8,
+    sortUpdated = 9,
+    sortViews = 10,
+} SortFld;
+
+typedef struct SortKey {
+    SortFld fld;
+    int desc;           // descending order
+} SortKey;
+
+#define MAX_SORT_KEYS   8
+
 typedef struct CmdArgs {
     const char *inFile;
     const char *category;
@@ -44,18 +66,32 @@ typedef struct CmdArgs {
     const char *mp4;
     const char *shiz;
     const char *title;
+    const char *ids;        // comma-separated list of route IDs
     const char *dlFolder;
+    const char *saveSnap;   // file to save a snapshot to
+    const char *since;      // snapshot to compare against
+    const char *serveSock;  // socket to serve queries on
     OutFmt outFmt;
+    FILE *outFile;          // where the output goes
+    const char *outPath;    // output file, if not stdout
+    const char *queryFile;  // file with the batch queries
     VidRes getVideo;
     Units units;
     int getShiz;
     int dlProg;
     int dryRun;
+    int explain;
+    int noCache;
+    int noDownload;
     int expGpx;
-    int maxDistance;
-    int maxDuration;
-    int maxElevGain;
-    int minDistance;
-    int minDuration;
-    int minElevGain;
+    double maxDistance;     // in km
+    double maxDuration;     // in minutes
+    double maxElevGain;     // in meters
+    double minDistance;
+    double minDuration;
+    double minElevGain;
+    int numThreads;
+    SortKey sortKeys[MAX_SORT_KEYS];
+    int numSortKeys;
+    int limit;
 } CmdArgs;
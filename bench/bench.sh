@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# Run the end-to-end benchmarks of the whatsOnFulGaz tool
+# using synthetic allrides files with 10k, 100k, and 1M
+# routes. The generated files are kept in the 'data'
+# folder, so they are only created the first time.
+#
+# The parsing benchmarks are run with --no-cache, while the
+# snapshot benchmarks use the snapshot saved by a prior run.
+#
+# The following environment variables can be used to
+# change the defaults:
+#
+#   BENCH_SIZES     list of library sizes (number of routes)
+#   BENCH_REPS      number of runs of each benchmark
+#   BENCH_TRKPTS    number of track points in the SHIZ files
+#   BENCH_SHIZ      number of SHIZ files to export as GPX
+#   BENCH_THREADS   number of threads for the --threads runs
+
+BENCH_DIR=`dirname $0`
+BIN=$BENCH_DIR/../whatsOnFulGaz
+DATA_DIR=$BENCH_DIR/data
+
+SIZES=${BENCH_SIZES:-"10000 100000 1000000"}
+REPS=${BENCH_REPS:-3}
+TRKPTS=${BENCH_TRKPTS:-10000}
+SHIZ=${BENCH_SHIZ:-10}
+THREADS=${BENCH_THREADS:-`getconf _NPROCESSORS_ONLN`}
+
+mkdir -p $DATA_DIR || exit 1
+
+$BENCH_DIR/runBench --header
+
+for SIZE in $SIZES
+do
+    ALLRIDES=$DATA_DIR/allrides_$SIZE.json
+    SHIZ_DIR=$DATA_DIR/shiz_$SIZE
+
+    if [ ! -f $ALLRIDES ]
+    then
+        mkdir -p $SHIZ_DIR || exit 1
+        $BENCH_DIR/genRides --routes $SIZE --shiz-folder $SHIZ_DIR --shiz-routes $SHIZ --trkpts $TRKPTS $ALLRIDES || exit 1
+    fi
+
+    RUN="$BENCH_DIR/runBench --reps $REPS --input $ALLRIDES"
+
+    $RUN "$SIZE/csv"                $BIN --no-cache --allrides-file $ALLRIDES --output-format csv
+    $RUN "$SIZE/html"               $BIN --no-cache --allrides-file $ALLRIDES --output-format html
+    $RUN "$SIZE/text"               $BIN --no-cache --allrides-file $ALLRIDES --output-format text
+    $RUN "$SIZE/csv/threads=$THREADS" $BIN --no-cache --allrides-file $ALLRIDES --output-format csv --threads $THREADS
+    $RUN "$SIZE/text/filters"       $BIN --no-cache --allrides-file $ALLRIDES --output-format text --country france --category hilly --min-distance 20 --max-duration 120
+    $RUN "$SIZE/text/title"         $BIN --no-cache --allrides-file $ALLRIDES --output-format text --title gavia
+    $RUN "$SIZE/text/no-match"      $BIN --no-cache --allrides-file $ALLRIDES --output-format text --title zzzz
+
+    # Save the snapshot of the allrides file, and then
+    # run from it.
+    rm -f $ALLRIDES.snap
+    $BIN --allrides-file $ALLRIDES --title zzzz > /dev/null || exit 1
+
+    $RUN "$SIZE/text/snapshot"      $BIN --allrides-file $ALLRIDES --output-format text
+    $RUN "$SIZE/text/snapshot/title" $BIN --allrides-file $ALLRIDES --output-format text --title gavia
+    $RUN "$SIZE/text/snapshot/sort"  $BIN --allrides-file $ALLRIDES --output-format text --sort-by country,-distance,title
+    $RUN "$SIZE/text/snapshot/top20" $BIN --allrides-file $ALLRIDES --output-format text --sort-by -toughness --limit 20
+
+    # A nightly batch of 40 reports, run from a single
+    # parse of the allrides file.
+    QUERY_FILE=$DATA_DIR/queries.txt
+    for KEY in france italy spain usa australia austria germany switzerland canada japan
+    do
+        echo "--country $KEY --output-format csv --output-file /dev/null"
+        echo "--country $KEY --category hilly --output-format csv --output-file /dev/null"
+        echo "--country $KEY --max-distance 40 --sort-by -toughness --output-format text --output-file /dev/null"
+        echo "--title $KEY --output-format html --output-file /dev/null"
+    done > $QUERY_FILE
+
+    $RUN "$SIZE/batch40"            $BIN --no-cache --allrides-file $ALLRIDES --query-file $QUERY_FILE
+    $RUN "$SIZE/batch40/snapshot"   $BIN --allrides-file $ALLRIDES --query-file $QUERY_FILE
+
+    SHIZ_INPUTS=`ls $SHIZ_DIR/*.shiz | sed 's/^/--input /'`
+
+    $RUN $SHIZ_INPUTS "$SIZE/export-gpx" \
+        $BIN --allrides-file $ALLRIDES --output-format csv --contributor "bench gpx" --export-gpx --no-download --download-folder $SHIZ_DIR
+done
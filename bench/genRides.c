@@ -0,0 +1,365 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * Generator of synthetic allrides_v4.json files, and of the
+ * SHIZ files of some of the routes, used to benchmark the
+ * whatsOnFulGaz tool with libraries of any size.
+ *
+ * The route records follow the same schema as the real ones,
+ * with similar string lengths, escape sequences, UTF-8 text,
+ * categories, etc. The SHIZ files are generated for every Nth
+ * route, and those routes are all credited to the contributor
+ * BENCH_GPX_CON, so that they can be selected using the option
+ * "--contributor" when exporting the GPX files.
+ */
+
+#define BENCH_GPX_CON   "Bench GPX Rider"
+
+static const char *help =
+        "SYNTAX:\n"
+        "    genRides [OPTIONS] <outFile>\n"
+        "\n"
+        "OPTIONS:\n"
+        "    --routes <num>\n"
+        "        Number of route records to generate. Default is 10000.\n"
+        "    --seed <num>\n"
+        "        Seed of the pseudo-random number generator. Default is 1.\n"
+        "    --shiz-folder <path>\n"
+        "        Folder where to create the SHIZ files.\n"
+        "    --shiz-routes <num>\n"
+        "        Number of routes for which a SHIZ file is created. Default is 10.\n"
+        "    --trkpts <num>\n"
+        "        Number of track points in each SHIZ file. Default is 10000.\n";
+
+typedef struct GenArgs {
+    const char *outFile;
+    const char *shizFolder;
+    unsigned long numRoutes;
+    unsigned long numShizRoutes;
+    unsigned long numTrkPts;
+    uint64_t seed;
+} GenArgs;
+
+static uint64_t rngState;
+
+// xorshift64* PRNG, so that the output only depends on the seed
+static uint64_t rnd(void)
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 2685821657736338717ULL;
+}
+
+// Random integer in the range [min, max]
+static long rndRange(long min, long max)
+{
+    return min + (long) (rnd() % (uint64_t) (max - min + 1));
+}
+
+// Random double in the range [min, max)
+static double rndDouble(double min, double max)
+{
+    return min + ((max - min) * ((rnd() >> 11) * (1.0 / 9007199254740992.0)));
+}
+
+#define ARRAY_SIZE(a)   (sizeof (a) / sizeof ((a)[0]))
+#define RND_PICK(a)     ((a)[rnd() % ARRAY_SIZE(a)])
+
+static const char *categories[] = {
+    "Easy", "Hilly", "IRONMAN", "Long", "Loop", "Mountain",
+    "New", "Race", "Sightseeing", "Trails", "Trending",
+};
+
+static const char *contributors[] = {
+    "Marcelo Mourier", "Franck Villano", "Rob Bennett", "Hans Peter Obwaller",
+    "Gavin Williams", "Kirsten Rasmussen", "Tomás O'Brien", "Jürgen Müller",
+    "Ana Sofía Gutiérrez", "Mitch Docker", "Emma Pooley", "Kenji Watanabe",
+};
+
+static const char *locations[] = {
+    "Hautes-Alpes/Alpes-de-Haute-Provence, France",
+    "Savoie, France",
+    "Barossa Valley, South Australia, Australia",
+    "Boulder, Colorado, USA",
+    "Napa, California, USA",
+    "Kona, Hawaii, USA",
+    "Córdoba, Córdoba, Argentina",
+    "Tyrol, Austria",
+    "Zürich, Zürich, Switzerland",
+    "Friuli-Venezia Giulia, Italy",
+    "Lombardia, Italy",
+    "Girona, Catalunya, Spain",
+    "Flanders, Belgium",
+    "Yorkshire, England, UK",
+    "Canterbury, New Zealand",
+    "Kyoto, Japan",
+};
+
+static const char *places[] = {
+    "Col de Vars", "Passo di Gavia", "Monte Zoncolan", "Alpe d'Huez",
+    "Mont Ventoux", "Stelvio", "Rocacorba", "Camino del Cuadrado",
+    "Mount Lofty", "Flagstaff", "Kapelmuur", "Tourmalet", "Galibier",
+    "Sa Calobra", "Hawi", "Lake Taupō", "Col de la Madeleine", "Dique",
+};
+
+static const char *qualifiers[] = {
+    "from", "via", "Loop from", "Descent to", "Sprint to", "Recovery Ride to",
+};
+
+static const char *sentences[] = {
+    "A relatively easy 5% start, although on very hot south-facing slopes.",
+    "The toughest sections are at more than 10% in the second half.",
+    "Filmed on the 2017 \\u00c9tape du Tour.",
+    "Used on stage 18 of the 2017 Tour de France.",
+    "The first rider over the summit at 2100m was Alexey Lutsenko (Astana).",
+    "Locals call it \\\"the wall\\\", and for good reason.",
+    "Beautiful views of the lake {and the valley} below.\\n",
+    "Watch out for the cattle grids on the descent.",
+    "The road surface is brand new, smooth as glass.",
+    "A classic climb in the region, with 21 hairpins to the top.",
+    "Perfect for a recovery day or a long endurance session.",
+    "Try it at sunrise for a truly magical experience!\\r\\n",
+};
+
+// Print a random description made of 2 to 8 sentences
+static void genDescription(FILE *fp)
+{
+    int numSentences = rndRange(2, 8);
+
+    for (int n = 0; n < numSentences; n++) {
+        fprintf(fp, "%s%s", (n != 0) ? "  " : "", RND_PICK(sentences));
+    }
+}
+
+// Print a random hex string of the specified length
+static void genHex(FILE *fp, int len)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    for (int n = 0; n < len; n++) {
+        fputc(hexDigits[rnd() & 0xf], fp);
+    }
+}
+
+// Print a random list of 1 to 3 categories
+static void genCategories(FILE *fp)
+{
+    int numCats = rndRange(1, 3);
+    int first = rnd() % ARRAY_SIZE(categories);
+
+    for (int n = 0; n < numCats; n++) {
+        fprintf(fp, "%s\"%s\"", (n != 0) ? "," : "", categories[(first + n) % ARRAY_SIZE(categories)]);
+    }
+}
+
+// Create a file name out of the title of the route
+static void genFileName(const char *title, char *fileName, size_t bufLen)
+{
+    size_t len = 0;
+
+    for (const unsigned char *p = (const unsigned char *) title; (*p != '\0') && (len < (bufLen - 1)); p++) {
+        if (((*p >= 'A') && (*p <= 'Z')) || ((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9'))) {
+            fileName[len++] = *p;
+        } else if ((*p == ' ') || (*p == '-')) {
+            fileName[len++] = '_';
+        }
+    }
+
+    fileName[len] = '\0';
+}
+
+// Create the SHIZ file of a route
+static int genShizFile(const GenArgs *pArgs, const char *title, const char *fileName)
+{
+    char filePath[1024];
+    FILE *fp;
+    int quoted = rnd() & 1;     // numeric values as strings or as numbers
+    const char *q = quoted ? "\"" : "";
+    double lon = rndDouble(-120.0, 150.0);
+    double lat = rndDouble(-45.0, 60.0);
+    double ele = rndDouble(0.0, 2500.0);
+    double distance = 0.0;
+
+    snprintf(filePath, sizeof (filePath), "%s/%s", pArgs->shizFolder, fileName);
+
+    if ((fp = fopen(filePath, "w")) == NULL) {
+        fprintf(stderr, "ERROR: can't create file \"%s\" (%s)\n", filePath, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "{\"gpx\":{\"-creator\":\"FulGaz\",\"-version\":\"1.1\",\"trk\":{\"name\":\"%s\",\"trkseg\":{\"trkpt\":[", title);
+
+    for (unsigned long n = 0; n < pArgs->numTrkPts; n++) {
+        double speed = rndDouble(5.0, 55.0);
+        double slope = rndDouble(-12.0, 12.0);
+        double bearing = rndDouble(0.0, 360.0);
+        unsigned long sec = n;
+
+        fprintf(fp, "%s{\"-lon\":%s%.6f%s,\"-lat\":%s%.6f%s,\"speed\":%s%.1f%s,\"ele\":%s%.1f%s,\"distance\":%s%.3f%s,"
+                "\"bearing\":%s%.1f%s,\"slope\":%s%.1f%s,\"time\":\"%02lu:%02lu:%02lu\",\"index\":%lu}",
+                (n != 0) ? "," : "",
+                q, lon, q, q, lat, q, q, speed, q, q, ele, q, q, distance, q,
+                q, bearing, q, q, slope, q,
+                (sec / 3600), ((sec / 60) % 60), (sec % 60), n);
+
+        lon += rndDouble(-0.0001, 0.0001);
+        lat += rndDouble(-0.0001, 0.0001);
+        ele += slope * 0.05;
+        distance += speed / 3600.0;
+    }
+
+    fprintf(fp, "]}}}}\n");
+
+    fclose(fp);
+
+    return 0;
+}
+
+// Print a route record
+static int genRoute(FILE *fp, const GenArgs *pArgs, unsigned long index, int withShiz)
+{
+    char title[256];
+    char fileName[256];
+    char shizName[300];
+    int sec = rndRange(5 * 60, 4 * 3600);
+
+    snprintf(title, sizeof (title), "%s%s %s %s %lu",
+             ((rnd() % 16) == 0) ? "Étape du Tour - " : "",
+             RND_PICK(places), RND_PICK(qualifiers), RND_PICK(places), index);
+    genFileName(title, fileName, sizeof (fileName));
+    snprintf(shizName, sizeof (shizName), "%s-seg.shiz", fileName);
+
+    fprintf(fp, "{\"_id\":\"");
+    genHex(fp, 24);
+    fprintf(fp, "\",\"appId\":\"");
+    genHex(fp, 40);
+    fprintf(fp, "\",\"vim1080\":{\"file\":\"1080P/%s.mp4\",\"sha\":\"", fileName);
+    genHex(fp, 64);
+    fprintf(fp, "\"},\"vim720\":{\"file\":\"720P/%s.mp4\",\"sha\":\"", fileName);
+    genHex(fp, 64);
+    fprintf(fp, "\"},\"meta\":{\"country\":\"all\",\"dur\":\"%d:%02d:%02d\",\"dis\":\"%.2f\",\"des\":\"",
+            (sec / 3600), ((sec / 60) % 60), (sec % 60), rndDouble(1.0, 180.0));
+    genDescription(fp);
+    fprintf(fp, "\",\"cat\":[");
+    genCategories(fp);
+    fprintf(fp, "],\"ele\":\"%ld\",\"tou\":\"%ld\",\"loc\":\"%s\",\"con\":\"%s\",\"ter\":\"\"},",
+            rndRange(0, 3500), rndRange(0, 1000), RND_PICK(locations),
+            withShiz ? BENCH_GPX_CON : RND_PICK(contributors));
+    fprintf(fp, "\"compType\":\"single\",\"vimMaster\":{\"file\":\"%s%s%s\"},\"views\":%ld,",
+            (rnd() & 1) ? "4K/" : "", (rnd() & 1) ? fileName : "", (rnd() & 1) ? ".mp4" : "", rndRange(0, 20000));
+    fprintf(fp, "\"hls\":\"https://fulgazhls.cachefly.net/file/fulgaz-videos/,1080P,720P,/%s.mp4.cf/master.m3u8\",", fileName);
+    fprintf(fp, "\"avatarMode\":0,\"forceDownload\":false,\"product\":\"fulgaz\",\"workoutURL\":\"\",");
+    fprintf(fp, "\"a\":{\"image\":[\"%s.jpg\"],\"file\":[\"%s\"]},", fileName, shizName);
+    fprintf(fp, "\"u\":%" PRIu64 ",\"loc\":{\"lat\":%.6f,\"lon\":%.6f},\"t\":\"%s\"}",
+            (uint64_t) (1450000000000ULL + (rnd() % 300000000000ULL)),
+            rndDouble(-45.0, 60.0), rndDouble(-120.0, 150.0), title);
+
+    if (withShiz)
+        return genShizFile(pArgs, title, shizName);
+
+    return 0;
+}
+
+static int parseArgs(int argc, char *argv[], GenArgs *pArgs)
+{
+    pArgs->numRoutes = 10000;
+    pArgs->numShizRoutes = 10;
+    pArgs->numTrkPts = 10000;
+    pArgs->seed = 1;
+
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+
+        if (strcmp(arg, "--help") == 0) {
+            fprintf(stdout, "%s\n", help);
+            exit(0);
+        } else if ((arg[0] == '-') && (arg[1] == '-') && ((n + 1) >= argc)) {
+            fprintf(stderr, "Missing value for option: %s\n", arg);
+            return -1;
+        } else if (strcmp(arg, "--routes") == 0) {
+            pArgs->numRoutes = strtoul(argv[++n], NULL, 0);
+        } else if (strcmp(arg, "--seed") == 0) {
+            pArgs->seed = strtoull(argv[++n], NULL, 0);
+        } else if (strcmp(arg, "--shiz-folder") == 0) {
+            pArgs->shizFolder = argv[++n];
+        } else if (strcmp(arg, "--shiz-routes") == 0) {
+            pArgs->numShizRoutes = strtoul(argv[++n], NULL, 0);
+        } else if (strcmp(arg, "--trkpts") == 0) {
+            pArgs->numTrkPts = strtoul(argv[++n], NULL, 0);
+        } else if ((arg[0] != '-') && (pArgs->outFile == NULL)) {
+            pArgs->outFile = arg;
+        } else {
+            fprintf(stderr, "Invalid option: %s\n", arg);
+            return -1;
+        }
+    }
+
+    if (pArgs->outFile == NULL) {
+        fprintf(stderr, "Missing output file name\n");
+        return -1;
+    }
+
+    if (pArgs->shizFolder != NULL) {
+        struct stat stBuf = {0};
+        if ((stat(pArgs->shizFolder, &stBuf) != 0) || !S_ISDIR(stBuf.st_mode)) {
+            fprintf(stderr, "Invalid SHIZ folder: %s\n", pArgs->shizFolder);
+            return -1;
+        }
+    } else {
+        pArgs->numShizRoutes = 0;
+    }
+
+    if (pArgs->numShizRoutes > pArgs->numRoutes)
+        pArgs->numShizRoutes = pArgs->numRoutes;
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    GenArgs genArgs = {0};
+    unsigned long shizStep;
+    FILE *fp;
+
+    if (parseArgs(argc, argv, &genArgs) != 0) {
+        fprintf(stderr, "Use --help for the list of supported options.\n\n");
+        return -1;
+    }
+
+    rngState = (genArgs.seed * 0x9e3779b97f4a7c15ULL) | 1;
+    shizStep = (genArgs.numShizRoutes != 0) ? (genArgs.numRoutes / genArgs.numShizRoutes) : 0;
+
+    if ((fp = fopen(genArgs.outFile, "w")) == NULL) {
+        fprintf(stderr, "ERROR: can't create file \"%s\" (%s)\n", genArgs.outFile, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "{\"result\":\"success\",\"prefix\":\"https://fulgaz.cachefly.net/file/fulgaz-videos/\",\"data\":[");
+
+    for (unsigned long n = 0; n < genArgs.numRoutes; n++) {
+        int withShiz = (shizStep != 0) && ((n % shizStep) == 0) && ((n / shizStep) < genArgs.numShizRoutes);
+
+        if (n != 0)
+            fputc(',', fp);
+
+        if (genRoute(fp, &genArgs, n, withShiz) != 0) {
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    fprintf(fp, "]}\n");
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "ERROR: can't write file \"%s\" (%s)\n", genArgs.outFile, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,441 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "args.h"
+#include "json.h"
+#include "output.h"
+#include "strutil.h"
+
+/*
+ * Microbenchmarks of the hot primitives of the whatsOnFulGaz
+ * tool: the JSON lookups, the case-insensitive search used by
+ * the match filters, and the output formatters.
+ *
+ * Each benchmark runs a single operation in a loop. The number
+ * of operations per sample is calibrated so that each sample
+ * takes about the specified time; then, after some warmup
+ * samples, the specified number of samples are taken, and the
+ * ns/op statistics are computed over them. The bytes/op value
+ * is the size of the input each operation works on; e.g. the
+ * text of the JSON object searched.
+ */
+
+static const char *help =
+        "SYNTAX:\n"
+        "    microBench [OPTIONS] [<name> ...]\n"
+        "\n"
+        "    Runs the microbenchmarks whose name contains any of the specified\n"
+        "    names, or all of them if none is specified.\n"
+        "\n"
+        "OPTIONS:\n"
+        "    --list\n"
+        "        List the available benchmarks and exit.\n"
+        "    --reps <num>\n"
+        "        Number of samples to take. Default is 15.\n"
+        "    --sample-ms <num>\n"
+        "        Target duration of each sample (in ms). Default is 20.\n"
+        "    --warmup <num>\n"
+        "        Number of warmup samples to discard. Default is 3.\n";
+
+#define MAX_REPS    1000
+
+// A route record, as found in the allrides_v4.json file
+static char routeText[] =
+        "{\"_id\":\"f1b5ca99119ffe68fbe6f0fa\",\"appId\":\"55f780c682d4002ba4cc479077db57a400cbe240\","
+        "\"vim1080\":{\"file\":\"1080P/Col_de_Vars.mp4\",\"sha\":\"25e786e7a89ebbe330ebabbc6e8ba499957a4a013781332363adbba55e2f2044\"},"
+        "\"vim720\":{\"file\":\"720P/Col_de_Vars.mp4\",\"sha\":\"68faac82299ec6097b4a6d22c0cff3efecbcc9d7c4397250b0f8e4d062a1ba9d\"},"
+        "\"meta\":{\"country\":\"all\",\"dur\":\"1:08:21\",\"dis\":\"15.26\","
+        "\"des\":\"A relatively easy 5% start, although on very hot south-facing slopes, with the toughest sections at more than "
+        "10% in the second half.  Filmed on the 2017 \\u00c9tape du Tour.  Used on stage 18 of the 2017 Tour de France, the "
+        "first rider over the summit at 2100m was Alexey Lutsenko (Astana) from Kazakhstan\","
+        "\"cat\":[\"Hilly\"],\"ele\":\"682\",\"tou\":\"473\",\"loc\":\"Hautes-Alpes/Alpes-de-Haute-Provence, France\","
+        "\"con\":\"Franck Villano\",\"ter\":\"\"},"
+        "\"compType\":\"single\",\"vimMaster\":{\"file\":\"\"},\"views\":173,"
+        "\"hls\":\"https://fulgazhls.cachefly.net/file/fulgaz-videos/,1080P,720P,/Col_de_Vars.mp4.cf/master.m3u8\","
+        "\"avatarMode\":0,\"forceDownload\":false,\"product\":\"fulgaz\",\"workoutURL\":\"\","
+        "\"a\":{\"image\":[\"Col_de_Vars.jpg\"],\"file\":[\"Col_de_Vars-seg.shiz\"]},"
+        "\"u\":1517239331176,\"loc\":{\"lat\":44.509897,\"lon\":6.746794},"
+        "\"t\":\"Etape du Tour 2017 - Col de Vars from Saint-Paul-sur-Ubaye \"}";
+
+// A track point, as found in a SHIZ file
+static char trkPtText[] =
+        "{\"-lon\":\"5.280152\",\"-lat\":\"44.174612\",\"speed\":\"13.9\",\"ele\":\"1876.6\",\"distance\":\"20.719\","
+        "\"bearing\":\"239.8\",\"slope\":\"6.2\",\"time\":\"02:03:59\",\"index\":7439}";
+
+static const JsonStrView location = { "Barossa Valley, South Australia, Australia", 42 };
+static const JsonStrView title = { "Etape du Tour 2017 - Col de Vars from Saint-Paul-sur-Ubaye ", 59 };
+static const JsonStrView utf8Title = { "\xc3\x89tape du Tour 2017 - Col de Vars from Saint-Paul-sur-Ubaye ", 60 };
+
+// Input data of the benchmarks
+typedef struct MbData {
+    JsonObject route;       // route object, without tape
+    JsonObject routeTp;     // route object, with tape
+    JsonObject trkPt;       // trkpt object, without tape
+    JsonObject trkPtTp;     // trkpt object, with tape
+    JsonTape routeTape;
+    JsonTape trkPtTape;
+} MbData;
+
+static MbData mbData;
+
+// Sink for the results of the operations, so that the
+// compiler can't optimize them away.
+static volatile uintptr_t mbSink;
+
+// A benchmark performs one operation and returns the
+// number of bytes of input it worked on.
+typedef size_t (*MbFunc)(const MbData *pData);
+
+typedef struct MbCase {
+    const char *name;
+    MbFunc func;
+} MbCase;
+
+static size_t objLen(const JsonObject *pObj)
+{
+    return pObj->end - pObj->start + 1;
+}
+
+static size_t mbJsonFindObject(const MbData *pData)
+{
+    JsonObject obj;
+
+    jsonFindObject(routeText, (sizeof (routeText) - 1), &obj);
+    mbSink = (uintptr_t) obj.end;
+
+    return sizeof (routeText) - 1;
+}
+
+static size_t mbJsonTapeBuild(const MbData *pData)
+{
+    JsonTape tape;
+
+    jsonTapeBuild(routeText, (sizeof (routeText) - 1), &tape);
+    mbSink = tape.numEnts;
+    jsonTapeFree(&tape);
+
+    return sizeof (routeText) - 1;
+}
+
+static size_t mbJsonFindTag(const MbData *pData)
+{
+    mbSink = (uintptr_t) jsonFindTag(&pData->route, "t");
+    return objLen(&pData->route);
+}
+
+static size_t mbJsonFindTagTape(const MbData *pData)
+{
+    mbSink = (uintptr_t) jsonFindTag(&pData->routeTp, "t");
+    return objLen(&pData->routeTp);
+}
+
+static size_t mbJsonGetStringValue(const MbData *pData)
+{
+    char *val = NULL;
+
+    jsonGetStringValue(&pData->route, "t", &val);
+    mbSink = (uintptr_t) val;
+    free(val);
+
+    return objLen(&pData->route);
+}
+
+static size_t mbJsonGetStringValueTape(const MbData *pData)
+{
+    char *val = NULL;
+
+    jsonGetStringValue(&pData->routeTp, "t", &val);
+    mbSink = (uintptr_t) val;
+    free(val);
+
+    return objLen(&pData->routeTp);
+}
+
+static size_t mbJsonGetStringView(const MbData *pData)
+{
+    JsonStrView view;
+
+    jsonGetStringView(&pData->route, "t", &view);
+    mbSink = view.len;
+
+    return objLen(&pData->route);
+}
+
+static size_t mbJsonGetStrDoubleValue(const MbData *pData)
+{
+    double val = 0.0;
+
+    jsonGetStrDoubleValue(&pData->trkPt, "slope", &val);
+    mbSink = (uintptr_t) val;
+
+    return objLen(&pData->trkPt);
+}
+
+static size_t mbJsonGetStrDoubleValueTape(const MbData *pData)
+{
+    double val = 0.0;
+
+    jsonGetStrDoubleValue(&pData->trkPtTp, "slope", &val);
+    mbSink = (uintptr_t) val;
+
+    return objLen(&pData->trkPtTp);
+}
+
+static size_t mbJsonGetStrTimeValue(const MbData *pData)
+{
+    time_t val = 0;
+
+    jsonGetStrTimeValue(&pData->trkPt, "time", &val);
+    mbSink = val;
+
+    return objLen(&pData->trkPt);
+}
+
+static size_t mbJsonGetStrTimeValueTape(const MbData *pData)
+{
+    time_t val = 0;
+
+    jsonGetStrTimeValue(&pData->trkPtTp, "time", &val);
+    mbSink = val;
+
+    return objLen(&pData->trkPtTp);
+}
+
+static size_t mbJsonParseDouble(const MbData *pData)
+{
+    double val = 0.0;
+
+    jsonParseDouble("44.174612", 9, &val);
+    mbSink = (uintptr_t) val;
+
+    return 9;
+}
+
+static size_t mbStrNormAscii(const MbData *pData)
+{
+    char buf[64];
+
+    mbSink = strNorm(title.str, title.len, 1, buf);
+    return title.len;
+}
+
+static size_t mbStrNormUtf8(const MbData *pData)
+{
+    char buf[64];
+
+    mbSink = strNorm(utf8Title.str, utf8Title.len, 1, buf);
+    return utf8Title.len;
+}
+
+static const JsonStrView normTitle = { "etape du tour 2017 - col de vars from saint-paul-sur-ubaye ", 59 };
+
+static size_t mbStrFindHit(const MbData *pData)
+{
+    mbSink = (uintptr_t) strFind(&normTitle, "saint-paul", 10);
+    return normTitle.len;
+}
+
+static size_t mbStrFindMiss(const MbData *pData)
+{
+    mbSink = (uintptr_t) strFind(&normTitle, "zoncolan", 8);
+    return normTitle.len;
+}
+
+static size_t mbFmtCountry(const MbData *pData)
+{
+    mbSink = (uintptr_t) fmtCountry(&location);
+    return location.len;
+}
+
+static size_t mbFmtProvince(const MbData *pData)
+{
+    mbSink = (uintptr_t) fmtProvince(&location);
+    return location.len;
+}
+
+static size_t mbFmtDistance(const MbData *pData)
+{
+    mbSink = (uintptr_t) fmtDistance(15.26, imperial);
+    return sizeof (float);
+}
+
+static size_t mbFmtTime(const MbData *pData)
+{
+    mbSink = (uintptr_t) fmtTime(4101);
+    return sizeof (int);
+}
+
+static const MbCase mbCases[] = {
+    { "jsonFindObject", mbJsonFindObject },
+    { "jsonTapeBuild", mbJsonTapeBuild },
+    { "jsonFindTag", mbJsonFindTag },
+    { "jsonFindTag/tape", mbJsonFindTagTape },
+    { "jsonGetStringValue", mbJsonGetStringValue },
+    { "jsonGetStringValue/tape", mbJsonGetStringValueTape },
+    { "jsonGetStringView", mbJsonGetStringView },
+    { "jsonGetStrDoubleValue", mbJsonGetStrDoubleValue },
+    { "jsonGetStrDoubleValue/tape", mbJsonGetStrDoubleValueTape },
+    { "jsonGetStrTimeValue", mbJsonGetStrTimeValue },
+    { "jsonGetStrTimeValue/tape", mbJsonGetStrTimeValueTape },
+    { "jsonParseDouble", mbJsonParseDouble },
+    { "strNorm/ascii", mbStrNormAscii },
+    { "strNorm/utf8", mbStrNormUtf8 },
+    { "strFind/hit", mbStrFindHit },
+    { "strFind/miss", mbStrFindMiss },
+    { "fmtCountry", mbFmtCountry },
+    { "fmtProvince", mbFmtProvince },
+    { "fmtDistance", mbFmtDistance },
+    { "fmtTime", mbFmtTime },
+};
+
+#define MB_NUM_CASES    (sizeof (mbCases) / sizeof (mbCases[0]))
+
+static double nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double d1 = *(const double *) a;
+    double d2 = *(const double *) b;
+
+    return (d1 > d2) - (d1 < d2);
+}
+
+// Run the benchmark 'numOps' times and return the
+// elapsed time (in ns).
+static double runSample(const MbCase *pCase, size_t numOps)
+{
+    double start = nowNs();
+
+    for (size_t n = 0; n < numOps; n++) {
+        pCase->func(&mbData);
+    }
+
+    return nowNs() - start;
+}
+
+static void runCase(const MbCase *pCase, int numReps, int numWarmup, double sampleMs)
+{
+    double nsPerOp[MAX_REPS];
+    size_t bytesPerOp = pCase->func(&mbData);
+    size_t numOps = 1;
+    double mean = 0.0, var = 0.0, median;
+
+    // Calibrate the number of operations per sample
+    while (numOps < ((size_t) 1 << 40)) {
+        double ns = runSample(pCase, numOps);
+        if (ns >= (sampleMs * 1e6))
+            break;
+        numOps *= (ns < (sampleMs * 1e5)) ? 10 : 2;
+    }
+
+    for (int n = 0; n < numWarmup; n++) {
+        runSample(pCase, numOps);
+    }
+
+    for (int n = 0; n < numReps; n++) {
+        nsPerOp[n] = runSample(pCase, numOps) / numOps;
+        mean += nsPerOp[n];
+    }
+    mean /= numReps;
+
+    for (int n = 0; n < numReps; n++) {
+        var += (nsPerOp[n] - mean) * (nsPerOp[n] - mean);
+    }
+    var = (numReps > 1) ? (var / (numReps - 1)) : 0.0;
+
+    qsort(nsPerOp, numReps, sizeof (nsPerOp[0]), cmpDouble);
+    median = (numReps & 1) ? nsPerOp[numReps / 2] : ((nsPerOp[(numReps / 2) - 1] + nsPerOp[numReps / 2]) / 2.0);
+
+    printf("%-28s %10.1f %10.1f %10.1f %10.1f %7.1f%% %9zu %10.1f\n", pCase->name,
+           nsPerOp[0], median, mean, nsPerOp[numReps - 1], ((sqrt(var) / mean) * 100.0),
+           bytesPerOp, (bytesPerOp / median) * (1e9 / (1024.0 * 1024.0)));
+}
+
+static int mbDataInit(MbData *pData)
+{
+    if ((jsonFindObject(routeText, (sizeof (routeText) - 1), &pData->route) != 0) ||
+        (jsonFindObject(trkPtText, (sizeof (trkPtText) - 1), &pData->trkPt) != 0) ||
+        (jsonTapeBuild(routeText, (sizeof (routeText) - 1), &pData->routeTape) != 0) ||
+        (jsonTapeGetRoot(&pData->routeTape, &pData->routeTp) != 0) ||
+        (jsonTapeBuild(trkPtText, (sizeof (trkPtText) - 1), &pData->trkPtTape) != 0) ||
+        (jsonTapeGetRoot(&pData->trkPtTape, &pData->trkPtTp) != 0)) {
+        fprintf(stderr, "ERROR: can't parse the benchmark data!\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int numReps = 15;
+    int numWarmup = 3;
+    double sampleMs = 20.0;
+    int first;
+
+    for (first = 1; (first < argc) && (strncmp(argv[first], "--", 2) == 0); first++) {
+        const char *arg = argv[first];
+
+        if (strcmp(arg, "--help") == 0) {
+            fprintf(stdout, "%s\n", help);
+            return 0;
+        } else if (strcmp(arg, "--list") == 0) {
+            for (int n = 0; n < MB_NUM_CASES; n++) {
+                printf("%s\n", mbCases[n].name);
+            }
+            return 0;
+        } else if ((strcmp(arg, "--reps") == 0) && ((first + 1) < argc)) {
+            numReps = atoi(argv[++first]);
+            if ((numReps < 1) || (numReps > MAX_REPS)) {
+                fprintf(stderr, "Invalid number of samples: %s\n", argv[first]);
+                return -1;
+            }
+        } else if ((strcmp(arg, "--sample-ms") == 0) && ((first + 1) < argc)) {
+            sampleMs = atof(argv[++first]);
+            if (sampleMs <= 0.0) {
+                fprintf(stderr, "Invalid sample duration: %s\n", argv[first]);
+                return -1;
+            }
+        } else if ((strcmp(arg, "--warmup") == 0) && ((first + 1) < argc)) {
+            numWarmup = atoi(argv[++first]);
+            if (numWarmup < 0) {
+                fprintf(stderr, "Invalid number of warmup samples: %s\n", argv[first]);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Invalid option: %s\n", arg);
+            return -1;
+        }
+    }
+
+    if (mbDataInit(&mbData) != 0)
+        return -1;
+
+    printf("%-28s %10s %10s %10s %10s %8s %9s %10s\n", "BENCHMARK (ns/op)",
+           "MIN", "MEDIAN", "MEAN", "MAX", "STDDEV", "BYTES/OP", "MB/s");
+
+    for (int n = 0; n < MB_NUM_CASES; n++) {
+        const MbCase *pCase = &mbCases[n];
+        int run = (first == argc);
+
+        for (int f = first; f < argc; f++) {
+            if (strstr(pCase->name, argv[f]) != NULL)
+                run = 1;
+        }
+
+        if (run)
+            runCase(pCase, numReps, numWarmup, sampleMs);
+    }
+
+    return 0;
+}
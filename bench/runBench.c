@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Runner of the end-to-end benchmarks: it runs the specified
+ * command a number of times, with its output discarded, and
+ * prints a line with the wall time, the peak RSS, and the
+ * throughput (based on the size of the input files) of the
+ * runs.
+ */
+
+static const char *help =
+        "SYNTAX:\n"
+        "    runBench [OPTIONS] <label> <cmd> [<arg> ...]\n"
+        "    runBench --header\n"
+        "\n"
+        "OPTIONS:\n"
+        "    --input <path>\n"
+        "        Input file of the command, used to compute the throughput. Can be\n"
+        "        specified multiple times, in which case the sizes are added up.\n"
+        "    --reps <num>\n"
+        "        Number of times to run the command. Default is 3.\n";
+
+#define MAX_REPS    100
+
+static double nowMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double d1 = *(const double *) a;
+    double d2 = *(const double *) b;
+
+    return (d1 > d2) - (d1 < d2);
+}
+
+// Run the command once, and return its wall time (in ms)
+// and its peak RSS (in KB).
+static int runCmd(char *argv[], double *pWallMs, long *pMaxRssKb)
+{
+    struct rusage ru = {0};
+    double start = nowMs();
+    int status;
+    pid_t pid;
+
+    if ((pid = fork()) < 0) {
+        fprintf(stderr, "ERROR: can't fork (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    if (pid == 0) {
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    if (wait4(pid, &status, 0, &ru) != pid) {
+        fprintf(stderr, "ERROR: can't wait for child (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    *pWallMs = nowMs() - start;
+#ifdef __APPLE__
+    *pMaxRssKb = ru.ru_maxrss / 1024;   // in bytes
+#else
+    *pMaxRssKb = ru.ru_maxrss;          // in KB
+#endif
+
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        fprintf(stderr, "ERROR: command \"%s\" failed (status=0x%x)\n", argv[0], status);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    double wallMs[MAX_REPS];
+    long maxRssKb = 0;
+    off_t inputSize = 0;
+    int numReps = 3;
+    const char *label;
+    double median;
+    int n;
+
+    for (n = 1; (n < argc) && (strncmp(argv[n], "--", 2) == 0); n++) {
+        const char *arg = argv[n];
+
+        if (strcmp(arg, "--help") == 0) {
+            fprintf(stdout, "%s\n", help);
+            return 0;
+        } else if (strcmp(arg, "--header") == 0) {
+            printf("%-40s %10s %10s %10s %10s %10s\n", "BENCHMARK", "MIN(ms)", "MEDIAN(ms)", "MAX(ms)", "RSS(MB)", "MB/s");
+            return 0;
+        } else if ((strcmp(arg, "--input") == 0) && ((n + 1) < argc)) {
+            struct stat stBuf = {0};
+            if (stat(argv[++n], &stBuf) != 0) {
+                fprintf(stderr, "Invalid input file: %s\n", argv[n]);
+                return -1;
+            }
+            inputSize += stBuf.st_size;
+        } else if ((strcmp(arg, "--reps") == 0) && ((n + 1) < argc)) {
+            numReps = atoi(argv[++n]);
+            if ((numReps < 1) || (numReps > MAX_REPS)) {
+                fprintf(stderr, "Invalid number of repetitions: %s\n", argv[n]);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "Invalid option: %s\n", arg);
+            return -1;
+        }
+    }
+
+    if ((argc - n) < 2) {
+        fprintf(stderr, "%s\n", help);
+        return -1;
+    }
+
+    label = argv[n++];
+
+    for (int r = 0; r < numReps; r++) {
+        long rssKb;
+
+        if (runCmd(&argv[n], &wallMs[r], &rssKb) != 0) {
+            printf("%-40s %10s\n", label, "FAILED");
+            return -1;
+        }
+
+        if (rssKb > maxRssKb)
+            maxRssKb = rssKb;
+    }
+
+    qsort(wallMs, numReps, sizeof (wallMs[0]), cmpDouble);
+    median = (numReps & 1) ? wallMs[numReps / 2] : ((wallMs[(numReps / 2) - 1] + wallMs[numReps / 2]) / 2.0);
+
+    printf("%-40s %10.1f %10.1f %10.1f %10.1f %10.1f\n", label,
+           wallMs[0], median, wallMs[numReps - 1], (maxRssKb / 1024.0),
+           (inputSize / (1024.0 * 1024.0)) / (median / 1000.0));
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "filter.h"
+#include "strutil.h"
+
+/*
+ * The cost of a predicate is estimated in units of the cost
+ * of a range check, which is a compare of a column value. The
+ * cost of a string check is a fixed overhead, plus the cost
+ * of scanning the field, which is estimated from the average
+ * length of the fields checked so far. When the plan is
+ * pushed into the parser, the predicates also pay for parsing
+ * the number, or normalizing the field, they check.
+ *
+ * The predicates are evaluated in ascending order of their
+ * cost divided by the fraction of the routes they rule out,
+ * which is the order that minimizes the expected cost of the
+ * plan when the predicates are independent. The pass rates
+ * start at 50% and are smoothed, so a predicate that hasn't
+ * been checked much yet can't be ranked on a lucky chunk.
+ */
+
+#define FLT_CHUNK_SIZE      1024    // routes checked per chunk
+#define FLT_STR_BASE_COST   4       // fixed cost of a string check
+#define FLT_STR_BYTE_COST   0.125   // cost per byte of the string field
+#define FLT_STR_DEF_LEN     32      // field length assumed before any check
+#define FLT_NUM_PARSE_COST  4       // cost of parsing a number, if pushed down
+#define FLT_STR_NORM_COST   0.25    // cost per byte of normalizing the field, if pushed down
+
+static const char *rngFldNames[rrgNum] = {
+    [rrgDistance] = "distance",
+    [rrgDuration] = "duration",
+    [rrgElevation] = "elevation",
+};
+
+static const char *rngFldUnits[rrgNum] = {
+    [rrgDistance] = "km",
+    [rrgDuration] = "s",
+    [rrgElevation] = "m",
+};
+
+static void fltAddRange(FltPlan *pPlan, RtRngFld fld, double min, double max)
+{
+    FltPred *pPred = &pPlan->preds[pPlan->numPreds++];
+
+    pPred->type = fptRange;
+    pPred->fld = fld;
+    pPred->min = min;
+    pPred->max = max;
+    snprintf(pPred->desc, sizeof (pPred->desc), "%s in [%g, %g] %s", rngFldNames[fld], min, max, rngFldUnits[fld]);
+}
+
+static void fltAddString(FltPlan *pPlan, const char *name, RtNormFld fld, const char *value)
+{
+    FltPred *pPred = &pPlan->preds[pPlan->numPreds++];
+
+    pPred->type = fptString;
+    pPred->normFld = fld;
+    pPred->value = value;
+    pPred->valueLen = strlen(value);
+    snprintf(pPred->desc, sizeof (pPred->desc), "%s contains \"%s\"", name, value);
+}
+
+void fltCompile(FltPlan *pPlan, const CmdArgs *pArgs, int idxDone)
+{
+    memset(pPlan, 0, sizeof (*pPlan));
+
+    // The values are compared at the precision of the
+    // columns; the min/max duration is in minutes.
+    if (!idxDone) {
+        if ((pArgs->minDistance != -INFINITY) || (pArgs->maxDistance != INFINITY))
+            fltAddRange(pPlan, rrgDistance, pArgs->minDistance, pArgs->maxDistance);
+        if ((pArgs->minDuration != -INFINITY) || (pArgs->maxDuration != INFINITY))
+            fltAddRange(pPlan, rrgDuration, (pArgs->minDuration * 60), (pArgs->maxDuration * 60));
+        if ((pArgs->minElevGain != -INFINITY) || (pArgs->maxElevGain != INFINITY))
+            fltAddRange(pPlan, rrgElevation, pArgs->minElevGain, pArgs->maxElevGain);
+
+        if (pArgs->category != NULL)
+            fltAddString(pPlan, "categories", rnfCategories, pArgs->category);
+        if (pArgs->contributor != NULL)
+            fltAddString(pPlan, "contributor", rnfContributor, pArgs->contributor);
+        if (pArgs->country != NULL)
+            fltAddString(pPlan, "location", rnfLocation, pArgs->country);
+        if (pArgs->province != NULL)
+            fltAddString(pPlan, "location", rnfLocation, pArgs->province);
+    }
+    if (pArgs->mp4 != NULL)
+        fltAddString(pPlan, "vim1080", rnfVim1080, pArgs->mp4);
+    if (pArgs->shiz != NULL)
+        fltAddString(pPlan, "shiz", rnfShiz, pArgs->shiz);
+    if (pArgs->title != NULL)
+        fltAddString(pPlan, "title", rnfTitle, pArgs->title);
+
+    for (int n = 0; n < pPlan->numPreds; n++) {
+        pPlan->order[n] = n;
+    }
+}
+
+static double fltCost(const FltPlan *pPlan, const FltPred *pPred)
+{
+    double avgLen;
+
+    if (pPred->type == fptRange)
+        return pPlan->pushdown ? (1.0 + FLT_NUM_PARSE_COST) : 1.0;
+
+    avgLen = (pPred->numChecks != 0) ? ((double) pPred->numBytes / pPred->numChecks) : FLT_STR_DEF_LEN;
+
+    return FLT_STR_BASE_COST + (avgLen * (FLT_STR_BYTE_COST + (pPlan->pushdown ? FLT_STR_NORM_COST : 0.0)));
+}
+
+static double fltPassRate(const FltPred *pPred)
+{
+    return (pPred->numPass + 1.0) / (pPred->numChecks + 2.0);
+}
+
+// Cost of the predicate per route ruled out
+static double fltRank(const FltPlan *pPlan, const FltPred *pPred)
+{
+    return fltCost(pPlan, pPred) / (1.0 - fltPassRate(pPred));
+}
+
+// Reorder the predicates by rank, with an insertion sort,
+// since there are only a few of them and they are usually
+// already in order.
+static void fltReorder(FltPlan *pPlan)
+{
+    for (int i = 1; i < pPlan->numPreds; i++) {
+        int ord = pPlan->order[i];
+        double rank = fltRank(pPlan, &pPlan->preds[ord]);
+        int j;
+
+        for (j = i; (j > 0) && (fltRank(pPlan, &pPlan->preds[pPlan->order[j - 1]]) > rank); j--) {
+            pPlan->order[j] = pPlan->order[j - 1];
+        }
+        pPlan->order[j] = ord;
+    }
+}
+
+// DB index of the n-th route to filter
+#define FLT_ID(n)   ((ids != NULL) ? ids[n] : (first + (n)))
+
+// Check the routes of the chunk that are still alive against
+// the predicate, and return the number of them that passed,
+// which are moved to the front of the list. If the buffer for
+// the normalized fields is given, the plan is pushed into the
+// parser, and the value checked is parsed, or normalized, first.
+static int fltEval(RouteDB *pDb, RtNormBuf *pNormBuf, FltPred *pPred, const int *ids, int first, int *alive, int numAlive)
+{
+    int num = 0;
+
+    if (pPred->type == fptRange) {
+        const double min = pPred->min, max = pPred->max;
+
+        if (pNormBuf != NULL) {
+            for (int i = 0; i < numAlive; i++) {
+                rtDbParseCol(pDb, FLT_ID(alive[i]), pPred->fld);
+            }
+        }
+
+        // The compaction is branchless, since the outcome
+        // of a range check is hard to predict.
+        if (pPred->fld == rrgDuration) {
+            const int *col = pDb->duration;
+            for (int i = 0; i < numAlive; i++) {
+                int n = alive[i];
+                double val = col[FLT_ID(n)];
+                alive[num] = n;
+                num += (val >= min) & (val <= max);
+            }
+        } else {
+            const float *col = (pPred->fld == rrgDistance) ? pDb->distance : pDb->elevation;
+            for (int i = 0; i < numAlive; i++) {
+                int n = alive[i];
+                double val = col[FLT_ID(n)];
+                alive[num] = n;
+                num += (val >= min) & (val <= max);
+            }
+        }
+    } else {
+        uint64_t numBytes = 0;
+
+        for (int i = 0; i < numAlive; i++) {
+            int n = alive[i];
+            RouteInfo *pInfo = &pDb->routes[FLT_ID(n)];
+            const JsonStrView *pField = (pNormBuf != NULL) ? rtDbNormField(pNormBuf, pInfo, pPred->normFld) : rtDbNormView(pInfo, pPred->normFld);
+            numBytes += pField->len;
+            if (strFind(pField, pPred->value, pPred->valueLen) != NULL)
+                alive[num++] = n;
+        }
+        pPred->numBytes += numBytes;
+    }
+
+    pPred->numChecks += numAlive;
+    pPred->numPass += num;
+
+    return num;
+}
+
+static void fltRun(RouteDB *pDb, RtNormBuf *pNormBuf, FltPlan *pPlan, const int *ids, int first, int count, uint8_t *match)
+{
+    int alive[FLT_CHUNK_SIZE];
+
+    for (int base = 0; base < count; base += FLT_CHUNK_SIZE) {
+        int num = ((count - base) < FLT_CHUNK_SIZE) ? (count - base) : FLT_CHUNK_SIZE;
+        int numAlive = num;
+
+        for (int i = 0; i < num; i++) {
+            alive[i] = base + i;
+        }
+
+        for (int p = 0; (p < pPlan->numPreds) && (numAlive != 0); p++) {
+            numAlive = fltEval(pDb, pNormBuf, &pPlan->preds[pPlan->order[p]], ids, first, alive, numAlive);
+        }
+
+        memset(&match[base], 0, num);
+        for (int i = 0; i < numAlive; i++) {
+            match[alive[i]] = 1;
+        }
+
+        // Complete the routes that matched
+        if (pNormBuf != NULL) {
+            for (int i = 0; i < numAlive; i++) {
+                int id = FLT_ID(alive[i]);
+                rtDbParseCols(pDb, id);
+                rtDbNormRoute(pNormBuf, &pDb->routes[id]);
+            }
+        }
+
+        fltReorder(pPlan);
+    }
+}
+
+void fltApply(const RouteDB *pDb, FltPlan *pPlan, const int *ids, int first, int count, uint8_t *match)
+{
+    // The DB is only modified when the plan is pushed down
+    fltRun((RouteDB *) pDb, NULL, pPlan, ids, first, count, match);
+}
+
+void fltApplyLazy(RouteDB *pDb, FltPlan *pPlan, RtNormBuf *pNormBuf, int first, int count, uint8_t *match)
+{
+    pPlan->pushdown = 1;
+    fltRun(pDb, pNormBuf, pPlan, NULL, first, count, match);
+}
+
+void fltMerge(FltPlan *pDst, const FltPlan *pSrc)
+{
+    for (int n = 0; n < pDst->numPreds; n++) {
+        pDst->preds[n].numChecks += pSrc->preds[n].numChecks;
+        pDst->preds[n].numPass += pSrc->preds[n].numPass;
+        pDst->preds[n].numBytes += pSrc->preds[n].numBytes;
+    }
+
+    fltReorder(pDst);
+}
+
+void fltExplain(const FltPlan *pPlan, FILE *fp)
+{
+    if (pPlan->numPreds == 0) {
+        fprintf(fp, "Filter plan: no predicates\n");
+        return;
+    }
+
+    fprintf(fp, "Filter plan%s:\n", pPlan->pushdown ? " (pushed into the parser)" : "");
+    fprintf(fp, "  #  %-40s %6s %10s %10s %9s\n", "Predicate", "Cost", "Checked", "Passed", "Pass rate");
+    for (int p = 0; p < pPlan->numPreds; p++) {
+        const FltPred *pPred = &pPlan->preds[pPlan->order[p]];
+        double passRate = (pPred->numChecks != 0) ? (100.0 * pPred->numPass / pPred->numChecks) : 0.0;
+        fprintf(fp, "%3d  %-40s %6.1f %10" PRIu64 " %10" PRIu64 " %8.1f%%\n",
+                (p + 1), pPred->desc, fltCost(pPlan, pPred), pPred->numChecks, pPred->numPass, passRate);
+    }
+}
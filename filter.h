@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/cdefs.h>
+
+#include "args.h"
+#include "routedb.h"
+
+__BEGIN_DECLS
+
+// Max number of predicates in a filter plan
+#define FLT_MAX_PREDS   16
+
+typedef enum FltPredTyp {
+    fptRange = 1,   // value of a numeric column within a range
+    fptString = 2,  // substring of a string field
+} FltPredTyp;
+
+// Predicate of a filter plan, with the counters used to
+// estimate its selectivity and its cost.
+typedef struct FltPred {
+    FltPredTyp type;
+    char desc[96];          // description, for the plan
+    RtRngFld fld;           // column of a range predicate
+    double min, max;        // bounds of a range predicate
+    RtNormFld normFld;      // field of a string predicate
+    const char *value;      // normalized substring to search for
+    size_t valueLen;
+    uint64_t numChecks;     // routes checked
+    uint64_t numPass;       // routes that passed
+    uint64_t numBytes;      // bytes of the string fields checked
+} FltPred;
+
+// Filter plan: the active match filters, compiled into an
+// array of predicates, and the order in which they are
+// currently evaluated.
+typedef struct FltPlan {
+    int pushdown;           // applied by the parser (see fltApplyLazy())
+    int numPreds;
+    int order[FLT_MAX_PREDS];
+    FltPred preds[FLT_MAX_PREDS];
+} FltPlan;
+
+// Compile the match filters of the specified options into
+// a plan. If 'idxDone' is set, the filters on the fields with
+// an inverted or a range index are left out, as they have
+// already been applied using the indexes.
+extern void fltCompile(FltPlan *pPlan, const CmdArgs *pArgs, int idxDone);
+
+// Apply the plan to the routes [first, first+count) of the DB
+// or, if 'ids' is not NULL, to the routes in that list; and
+// flag the ones that match. The routes are checked in chunks,
+// and each predicate only checks the routes of the chunk that
+// passed the predicates before it. After each chunk the
+// predicates are reordered by their cost per route ruled out,
+// as observed so far, so the cheap and selective ones go first.
+extern void fltApply(const RouteDB *pDb, FltPlan *pPlan, const int *ids, int first, int count, uint8_t *match);
+
+// Apply the plan to the routes [first, first+count) of the DB
+// as they are parsed, once their fields have been extracted by
+// rtDbExtractRoute(): each predicate only parses the column, or
+// normalizes the field, that it checks, into the buffer of the
+// routes from rtDbNormBufAlloc(); and the rest of the route is
+// only parsed, and normalized, if the route matches.
+extern void fltApplyLazy(RouteDB *pDb, FltPlan *pPlan, RtNormBuf *pNormBuf, int first, int count, uint8_t *match);
+
+// Add the counters of a plan compiled from the same options
+// to the counters of the other plan, and reorder it.
+extern void fltMerge(FltPlan *pDst, const FltPlan *pSrc);
+
+// Print the plan, in its current order, and the pass rate of
+// each predicate.
+extern void fltExplain(const FltPlan *pPlan, FILE *fp);
+
+__END_DECLS
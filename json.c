@@ -9,6 +9,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #include "json.h"
 
 // Create a null-terminated string with the characters
@@ -26,6 +30,335 @@ static char *stringify(const char *start, const char *end)
     return str;
 }
 
+// The structural scanner walks the JSON text in blocks of 64
+// bytes. Each block is classified into bitmasks of the structural
+// characters { } [ ] : , of the double quotes, and of the
+// backslashes. The backslashes are used to discard the escaped
+// quotes, and the remaining quotes are used to mask out all the
+// structural characters that are inside a string. The scanner
+// then hands out the positions of the bits left in the mask, so
+// that brace matching and string skipping never need to look at
+// the text between the structural characters.
+typedef void (*JsonClassifier)(const char *blk, uint64_t *pOps, uint64_t *pQuotes, uint64_t *pBSlashes);
+
+typedef struct JsonScan {
+    const char *blk;        // start of the current block
+    const char *end;        // end of the data
+    uint64_t mask;          // structural characters left in the current block
+    uint64_t prevInStr;     // all ones if the previous block ended inside a string
+    uint64_t prevEscaped;   // 1 if the previous block ended with an escaping backslash
+} JsonScan;
+
+static void jsonClassifyScalar(const char *blk, uint64_t *pOps, uint64_t *pQuotes, uint64_t *pBSlashes)
+{
+    uint64_t ops = 0, quotes = 0, bSlashes = 0;
+
+    for (int n = 0; n < 64; n++) {
+        uint64_t bit = (uint64_t) 1 << n;
+        switch (blk[n]) {
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            ops |= bit;
+            break;
+        case '"':
+            quotes |= bit;
+            break;
+        case '\\':
+            bSlashes |= bit;
+            break;
+        }
+    }
+
+    *pOps = ops;
+    *pQuotes = quotes;
+    *pBSlashes = bSlashes;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void jsonClassifySse2(const char *blk, uint64_t *pOps, uint64_t *pQuotes, uint64_t *pBSlashes)
+{
+    uint64_t ops = 0, quotes = 0, bSlashes = 0;
+
+    for (int n = 0; n < 64; n += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (blk + n));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')), _mm_cmpeq_epi8(v, _mm_set1_epi8(']'))));
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        ops |= (uint64_t) (uint16_t) _mm_movemask_epi8(m) << n;
+        quotes |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << n;
+        bSlashes |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << n;
+    }
+
+    *pOps = ops;
+    *pQuotes = quotes;
+    *pBSlashes = bSlashes;
+}
+
+__attribute__((target("avx2")))
+static void jsonClassifyAvx2(const char *blk, uint64_t *pOps, uint64_t *pQuotes, uint64_t *pBSlashes)
+{
+    uint64_t ops = 0, quotes = 0, bSlashes = 0;
+
+    for (int n = 0; n < 64; n += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (blk + n));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']'))));
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        ops |= (uint64_t) (uint32_t) _mm256_movemask_epi8(m) << n;
+        quotes |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << n;
+        bSlashes |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << n;
+    }
+
+    *pOps = ops;
+    *pQuotes = quotes;
+    *pBSlashes = bSlashes;
+}
+#endif
+
+static JsonClassifier jsonClassify = jsonClassifyScalar;
+
+// Pick the best classifier supported by the CPU. This runs
+// before main(), so the classifier never changes while in use.
+__attribute__((constructor))
+static void jsonScanInit(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        jsonClassify = jsonClassifyAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        jsonClassify = jsonClassifySse2;
+    }
+#endif
+}
+
+// Return the mask of the characters escaped by a backslash:
+// i.e. the ones that follow an odd-length run of backslashes.
+static uint64_t jsonFindEscaped(uint64_t bSlashes, uint64_t *pPrevEscaped)
+{
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    uint64_t followsEscape, oddSeqStarts, seqsOnEvenBits;
+
+    bSlashes &= ~*pPrevEscaped;
+    followsEscape = (bSlashes << 1) | *pPrevEscaped;
+    oddSeqStarts = bSlashes & ~evenBits & ~followsEscape;
+    *pPrevEscaped = __builtin_add_overflow(oddSeqStarts, bSlashes, &seqsOnEvenBits);
+
+    return (evenBits ^ (seqsOnEvenBits << 1)) & followsEscape;
+}
+
+// Return the mask of the characters between each pair of
+// quotes, including the opening quote.
+static uint64_t jsonPrefixXor(uint64_t quotes)
+{
+    quotes ^= quotes << 1;
+    quotes ^= quotes << 2;
+    quotes ^= quotes << 4;
+    quotes ^= quotes << 8;
+    quotes ^= quotes << 16;
+    quotes ^= quotes << 32;
+
+    return quotes;
+}
+
+// Classify the current block
+static void jsonScanBlock(JsonScan *pScan)
+{
+    const char *blk = pScan->blk;
+    char buf[64];
+    uint64_t ops, quotes, bSlashes, inStr;
+
+    if ((pScan->end - blk) < 64) {
+        // Pad the last partial block with white space
+        memset(buf, ' ', sizeof (buf));
+        memcpy(buf, blk, (pScan->end - blk));
+        blk = buf;
+    }
+
+    jsonClassify(blk, &ops, &quotes, &bSlashes);
+    quotes &= ~jsonFindEscaped(bSlashes, &pScan->prevEscaped);
+    inStr = jsonPrefixXor(quotes) ^ pScan->prevInStr;
+    pScan->prevInStr = (uint64_t) ((int64_t) inStr >> 63);
+    pScan->mask = (ops & ~inStr) | quotes;
+}
+
+// Start scanning at 'p', which must not be inside a string
+static void jsonScanStart(JsonScan *pScan, const char *p, const char *end)
+{
+    pScan->blk = p;
+    pScan->end = end;
+    pScan->mask = 0;
+    pScan->prevInStr = 0;
+    pScan->prevEscaped = 0;
+
+    if (p < end)
+        jsonScanBlock(pScan);
+}
+
+// Return the next structural character, or NULL when
+// the end of the data has been reached.
+static const char *jsonScanNext(JsonScan *pScan)
+{
+    while (pScan->mask == 0) {
+        if ((pScan->end - pScan->blk) <= 64)
+            return NULL;
+        pScan->blk += 64;
+        jsonScanBlock(pScan);
+    }
+
+    {
+        int bit = __builtin_ctzll(pScan->mask);
+        pScan->mask &= (pScan->mask - 1);
+        return pScan->blk + bit;
+    }
+}
+
+// Locate the closing double quote of the string that starts
+// at 'openQuotes', skipping any escaped characters.
+static const char *jsonSkipString(const char *openQuotes, const char *end)
+{
+    JsonScan scan;
+
+    jsonScanStart(&scan, openQuotes, end);
+    jsonScanNext(&scan);    // the opening quote
+
+    return jsonScanNext(&scan);
+}
+
+// Locate the matching right curly brace or square bracket
+// of the object or array that starts at 'open', skipping
+// over any strings.
+static const char *jsonFindClose(const char *open, const char *end)
+{
+    JsonScan scan;
+    const char *p;
+    int level = 0;
+
+    jsonScanStart(&scan, open, end);
+    while ((p = jsonScanNext(&scan)) != NULL) {
+        switch (*p) {
+        case '{':
+        case '[':
+            level++;
+            break;
+        case '}':
+        case ']':
+            if (--level <= 0)
+                return (level == 0) ? p : NULL;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// Set up a JsonObject to refer to the specified tape entry
+static void jsonTapeSetObj(const JsonTape *pTape, uint32_t idx, JsonObject *pObj)
+{
+    const JsonTapeEnt *pEnt = &pTape->ents[idx];
+
+    pObj->start = (char *) pTape->data + pEnt->start;
+    pObj->end = (char *) pTape->data + pEnt->end;
+    pObj->tape = pTape;
+    pObj->tapeIdx = idx;
+}
+
+// Search the object or array recorded at the specified tape
+// entry for a member with the given key. The direct members
+// of an object are checked first, and only then are nested
+// objects and arrays searched, in document order.
+static const JsonTapeEnt *jsonTapeSearch(const JsonTape *pTape, uint32_t idx, const char *tag, size_t len)
+{
+    const JsonTapeEnt *pEnt = &pTape->ents[idx];
+    uint32_t n;
+
+    if (pEnt->type == jtObject) {
+        for (n = (idx + 1); n < pEnt->next; ) {
+            const JsonTapeEnt *pKey = &pTape->ents[n];
+            const JsonTapeEnt *pVal = pKey + 1;
+            size_t keyLen = pKey->end - pKey->start - 1;
+
+            if ((keyLen == len) && (memcmp((pTape->data + pKey->start + 1), tag, len) == 0)) {
+                return pVal;
+            }
+
+            n = pVal->next;
+        }
+    }
+
+    for (n = (idx + 1); n < pEnt->next; n = pTape->ents[n].next) {
+        const JsonTapeEnt *pVal = &pTape->ents[n];
+
+        if ((pVal->type == jtObject) || (pVal->type == jtArray)) {
+            if ((pVal = jsonTapeSearch(pTape, n, tag, len)) != NULL) {
+                return pVal;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Locate the tape entry with the value of the specified
+// member of the given object.
+static const JsonTapeEnt *jsonTapeFindTag(const JsonObject *pObj, const char *tag)
+{
+    return jsonTapeSearch(pObj->tape, pObj->tapeIdx, tag, strlen(tag));
+}
+
+// Append a new entry to the tape and return its index
+static int jsonTapeAdd(JsonTape *pTape, JsonTapeTyp type, const char *start, const char *end)
+{
+    JsonTapeEnt *pEnt;
+
+    if (pTape->numEnts == pTape->maxEnts) {
+        size_t maxEnts = (pTape->maxEnts != 0) ? (pTape->maxEnts * 2) : 1024;
+        JsonTapeEnt *ents;
+
+        if ((ents = realloc(pTape->ents, (maxEnts * sizeof (JsonTapeEnt)))) == NULL) {
+            fprintf(stderr, "ERROR: can't alloc JSON tape (%zu entries)!\n", maxEnts);
+            return -1;
+        }
+
+        pTape->ents = ents;
+        pTape->maxEnts = maxEnts;
+    }
+
+    pEnt = &pTape->ents[pTape->numEnts];
+    pEnt->start = start - pTape->data;
+    pEnt->end = end - pTape->data;
+    pEnt->next = pTape->numEnts + 1;
+    pEnt->type = type;
+
+    return pTape->numEnts++;
+}
+
+// If a number, true, false, or null value follows the ':', ','
+// or '[' character at 'p', add it to the tape.
+static int jsonTapeAddPrim(JsonTape *pTape, const char *p, const char *end)
+{
+    const char *first = p + 1;
+    const char *last;
+
+    while ((first < end) && isspace((unsigned char) *first))
+        first++;
+
+    if ((first == end) || (memchr("{}[]\",:", *first, 7) != NULL)) {
+        // Not a primitive value
+        return 0;
+    }
+
+    for (last = first; ((last + 1) < end) && (memchr(",}] \t\r\n", last[1], 7) == NULL); last++)
+        ;
+
+    return (jsonTapeAdd(pTape, jtPrim, first, last) < 0) ? -1 : 0;
+}
+
 #if 0
 static void dumpText(const char *data, size_t dataLen)
 {
@@ -62,6 +395,11 @@ const char *jsonFindTag(const JsonObject *pObj, const char *tag)
     char label[256];
     size_t len;
 
+    if (pObj->tape != NULL) {
+        const JsonTapeEnt *pVal = jsonTapeFindTag(pObj, tag);
+        return (pVal != NULL) ? (pObj->tape->data + pVal->start) : NULL;
+    }
+
     snprintf(label, sizeof (label), "\"%s\"", tag);
     len = strlen(label);
     for (const char *p = (pObj->start + 1); p < pObj->end; p++) {
@@ -79,30 +417,31 @@ const char *jsonFindTag(const JsonObject *pObj, const char *tag)
 }
 
 // Format is: "<tag>":[<ent0>,<ent1>,...,<entN>]
-int jsonGetArrayValue(const JsonObject *pObj, const char *tag, char **pVal)
+int jsonGetArrayView(const JsonObject *pObj, const char *tag, JsonStrView *pView)
 {
     const char *val;
 
+    if (pObj->tape != NULL) {
+        const JsonTapeEnt *pEnt = jsonTapeFindTag(pObj, tag);
+
+        if ((pEnt == NULL) || (pEnt->type != jtArray))
+            return -1;
+
+        pView->str = pObj->tape->data + pEnt->start;
+        pView->len = pEnt->end - pEnt->start + 1;
+        return 0;
+    }
+
     if ((val = jsonFindTag(pObj, tag)) != NULL) {
         // Locate the left square bracket
         const char *leftBracket = strchr(val, '[');
         if (leftBracket != NULL) {
             // Locate the matching right square bracket
-            int level = 0;
-            for (const char *p = leftBracket; p <= pObj->end; p++) {
-                if (*p == '[') {
-                    level++;
-                } else if (*p == ']') {
-                    level--;
-                }
-                if (level == 0) {
-                    const char *rightBracket = p;
-                    char *str = stringify(leftBracket, rightBracket);
-                    if (str != NULL) {
-                        *pVal = str;
-                        return 0;
-                    }
-                }
+            const char *rightBracket = jsonFindClose(leftBracket, (pObj->end + 1));
+            if (rightBracket != NULL) {
+                pView->str = leftBracket;
+                pView->len = rightBracket - leftBracket + 1;
+                return 0;
             }
         }
     }
@@ -110,6 +449,21 @@ int jsonGetArrayValue(const JsonObject *pObj, const char *tag, char **pVal)
     return -1;
 }
 
+// Format is: "<tag>":[<ent0>,<ent1>,...,<entN>]
+int jsonGetArrayValue(const JsonObject *pObj, const char *tag, char **pVal)
+{
+    JsonStrView view;
+    char *str;
+
+    if ((jsonGetArrayView(pObj, tag, &view) != 0) ||
+        ((str = stringify(view.str, (view.str + view.len - 1))) == NULL))
+        return -1;
+
+    *pVal = str;
+
+    return 0;
+}
+
 // A JSON object consists of text enclosed within matching
 // curly braces: e.g.
 //
@@ -120,39 +474,19 @@ int jsonFindObject(const char *data, size_t dataLen, JsonObject *pObj)
     const char *start = data;
     const char *end = data + dataLen - 1;
 
+    pObj->tape = NULL;
+    pObj->tapeIdx = 0;
+
     // Locate the left curly brace, within the
     // available data block...
-    while (start < end) {
-        if (*start == '{') {
-            pObj->start = (char *) start;
-            break;
-        } else {
-            start++;
-        }
-    }
-
-    if (start != end) {
-        int level = 0;
-
+    if ((start < end) && ((start = memchr(start, '{', (end - start))) != NULL)) {
         // Locate the matching right curly brace which
         // terminates the JSON object.
-        for (char *p = pObj->start; p <= end; p++) {
-            if (*p == '{') {
-                level++;
-                //printf("%s: p=%p level=%u\n", __func__, p, level);
-            } else if (*p == '}') {
-                if (level > 0) {
-                    level--;
-                    //printf("%s: p=%p level=%u\n", __func__, p, level);
-                } else {
-                    printf("%s: SPONG! Malformed JSON object!\n", __func__);
-                    break;
-                }
-                if (level == 0) {
-                    pObj->end = p;
-                    return 0;
-                }
-            }
+        const char *rightBrace = jsonFindClose(start, (end + 1));
+        if (rightBrace != NULL) {
+            pObj->start = (char *) start;
+            pObj->end = (char *) rightBrace;
+            return 0;
         }
     }
 
@@ -171,6 +505,16 @@ int jsonFindObjByTag(const JsonObject *pObj, const char *tag, JsonObject *pEmbOb
 {
     const char *lbl;
 
+    if (pObj->tape != NULL) {
+        const JsonTapeEnt *pEnt = jsonTapeFindTag(pObj, tag);
+
+        if ((pEnt == NULL) || (pEnt->type != jtObject))
+            return -1;
+
+        jsonTapeSetObj(pObj->tape, (pEnt - pObj->tape->ents), pEmbObj);
+        return 0;
+    }
+
     if ((lbl = jsonFindTag(pObj, tag)) != NULL) {
         size_t dataLen = (pObj->end - lbl);
         return jsonFindObject(lbl, dataLen, pEmbObj);
@@ -188,24 +532,29 @@ int jsonFindArrayByTag(const JsonObject *pObj, const char *tag, JsonObject *pArr
 {
     const char *val;
 
+    if (pObj->tape != NULL) {
+        const JsonTapeEnt *pEnt = jsonTapeFindTag(pObj, tag);
+
+        if ((pEnt == NULL) || (pEnt->type != jtArray))
+            return -1;
+
+        jsonTapeSetObj(pObj->tape, (pEnt - pObj->tape->ents), pArray);
+        return 0;
+    }
+
     if ((val = jsonFindTag(pObj, tag)) != NULL) {
         // Locate the left square bracket
         char *leftBracket = strchr(val, '[');
         if (leftBracket != NULL) {
             // Locate the matching right square bracket
-            int level = 0;
-            for (char *p = leftBracket; p <= pObj->end; p++) {
-                if (*p == '[') {
-                    level++;
-                } else if (*p == ']') {
-                    if (--level == 0) {
-                        char *rightBracket = p;
-                        pArray->start = leftBracket;
-                        pArray->end = rightBracket;
-                        //jsonDumpObject(pArray);
-                        return 0;
-                    }
-                }
+            const char *rightBracket = jsonFindClose(leftBracket, (pObj->end + 1));
+            if (rightBracket != NULL) {
+                pArray->start = leftBracket;
+                pArray->end = (char *) rightBracket;
+                pArray->tape = NULL;
+                pArray->tapeIdx = 0;
+                //jsonDumpObject(pArray);
+                return 0;
             }
         }
     }
@@ -213,35 +562,116 @@ int jsonFindArrayByTag(const JsonObject *pObj, const char *tag, JsonObject *pArr
     return -1;
 }
 
+// Locate the object element of the array that follows the
+// element 'pPrev', or the first one if 'pPrev' is NULL.
+static int jsonArrayNextObj(const JsonObject *pArray, const JsonObject *pPrev, JsonObject *pElem)
+{
+    const char *data;
+    size_t dataLen;
+
+    if (pArray->tape != NULL) {
+        const JsonTape *pTape = pArray->tape;
+        const JsonTapeEnt *pArrEnt = &pTape->ents[pArray->tapeIdx];
+        uint32_t n;
+
+        if (pArrEnt->type != jtArray)
+            return -1;
+
+        // Skip over the subtree of the previous element
+        n = (pPrev == NULL) ? (pArray->tapeIdx + 1) : pTape->ents[pPrev->tapeIdx].next;
+        for (; n < pArrEnt->next; n = pTape->ents[n].next) {
+            if (pTape->ents[n].type == jtObject) {
+                jsonTapeSetObj(pTape, n, pElem);
+                return 0;
+            }
+        }
+
+        return -1;
+    }
+
+    data = (pPrev == NULL) ? pArray->start : (pPrev->end + 1);
+    if (data >= pArray->end)
+        return -1;
+    dataLen = pArray->end - data + 1;
+
+    if (jsonFindObject(data, dataLen, pElem) != 0) {
+        //printf("%s: No more objects in the array! data=%p dataLen=%zu\n", __func__, data, dataLen);
+        return -1;
+    }
+
+    // Paranoia?
+    if ((pElem->start > pArray->end) || (pElem->end > pArray->end)) {
+        printf("%s: SPONG! Object is outside the data range: trkptStart=%p trkptEnd=%p dataLen=%zu\n", __func__, pElem->start, pElem->end, dataLen);
+        jsonDumpObject(pElem);
+        return -1;
+    }
+
+    return 0;
+}
+
 // Process each element object in the specified array
 int jsonArrayForEach(const JsonObject *pArray, JsonCbHdlr handler, void *arg)
 {
-    const char *data = pArray->start;
-    size_t dataLen = pArray->end - data + 1;
-    JsonObject trkptObj;
+    JsonObject elemObj;
+    int s;
 
-    //printf("%s: start=%p end=%p dataLen=%zu\n", __func__, pArray->start, pArray->end, dataLen);
+    for (s = jsonArrayNextObj(pArray, NULL, &elemObj); s == 0; s = jsonArrayNextObj(pArray, &elemObj, &elemObj)) {
+        // Call the handler
+        if (handler(&elemObj, arg) != 0) {
+            // Oops!
+            return -1;
+        }
+    }
 
-    while (data < pArray->end) {
-        if (jsonFindObject(data, dataLen, &trkptObj) == 0) {
-            // Paranoia?
-            if ((trkptObj.start > pArray->end) || (trkptObj.end > pArray->end)) {
-                printf("%s: SPONG! Object is outside the data range: trkptStart=%p trkptEnd=%p dataLen=%zu\n", __func__, trkptObj.start, trkptObj.end, dataLen);
-                jsonDumpObject(&trkptObj);
-                break;
-            }
+    return 0;
+}
 
-            // Call the handler
-            if (handler(&trkptObj, arg) != 0) {
-                // Oops!
-                return -1;
-            }
+// Split the elements of the array into consecutive parts
+int jsonArraySplit(const JsonObject *pArray, JsonArrayPart *pParts, int maxParts)
+{
+    JsonObject elemObj;
+    size_t numElems = 0;
+    size_t partSize;
+    int numParts = 0;
+    int s;
 
-            data = trkptObj.end + 1;
-            dataLen = pArray->end - data + 1;
-        } else {
-            //printf("%s: No more objects in the array! data=%p dataLen=%zu\n", __func__, data, dataLen);
-            break;
+    if (maxParts <= 0)
+        return 0;
+
+    // Count the elements
+    for (s = jsonArrayNextObj(pArray, NULL, &elemObj); s == 0; s = jsonArrayNextObj(pArray, &elemObj, &elemObj))
+        numElems++;
+
+    if (numElems == 0)
+        return 0;
+
+    partSize = (numElems + maxParts - 1) / maxParts;
+
+    // Mark the first element of each part
+    numElems = 0;
+    for (s = jsonArrayNextObj(pArray, NULL, &elemObj); s == 0; s = jsonArrayNextObj(pArray, &elemObj, &elemObj)) {
+        if ((numElems++ % partSize) == 0) {
+            JsonArrayPart *pPart = &pParts[numParts++];
+            pPart->array = *pArray;
+            pPart->first = elemObj;
+            pPart->numElems = 0;
+        }
+        pParts[numParts - 1].numElems++;
+    }
+
+    return numParts;
+}
+
+// Process each element in the specified part of an array
+int jsonArrayPartForEach(const JsonArrayPart *pPart, JsonCbHdlr handler, void *arg)
+{
+    JsonObject elemObj = pPart->first;
+
+    for (size_t n = 0; n < pPart->numElems; n++) {
+        if (((n != 0) && (jsonArrayNextObj(&pPart->array, &elemObj, &elemObj) != 0)) ||
+            (handler(&elemObj, arg) != 0)) {
+            // Oops!
+            return -1;
         }
     }
 
@@ -249,28 +679,37 @@ int jsonArrayForEach(const JsonObject *pArray, JsonCbHdlr handler, void *arg)
 }
 
 // Format is: "<tag>":"<val>" where the value is a string
-int jsonGetStringValue(const JsonObject *pObj, const char *tag, char **pVal)
+int jsonGetStringView(const JsonObject *pObj, const char *tag, JsonStrView *pView)
 {
     const char *val;
 
+    if (pObj->tape != NULL) {
+        const JsonTapeEnt *pEnt = jsonTapeFindTag(pObj, tag);
+
+        // Some string values come wrapped in an array; e.g.
+        //
+        //   "file":["Col_de_Vars-seg.shiz"]
+        //
+        // in which case the first element is used.
+        if ((pEnt != NULL) && (pEnt->type == jtArray) && ((pEnt + 1) < &pObj->tape->ents[pEnt->next]))
+            pEnt++;
+
+        if ((pEnt == NULL) || (pEnt->type != jtString))
+            return -1;
+
+        pView->str = pObj->tape->data + pEnt->start + 1;
+        pView->len = pEnt->end - pEnt->start - 1;
+        return 0;
+    }
+
     if ((val = jsonFindTag(pObj, tag)) != NULL) {
         const char *openQuotes = strchr(val, '"');
         if (openQuotes != NULL) {
-            for (const char *p = (openQuotes+1); p <= pObj->end; p++) {
-                if (*p == '"') {
-                    if (*(p - 1) == '\\') {
-                        // This is an escaped double quote that
-                        // is part of the string value...
-                        continue;
-                    } else {
-                        const char *endQuotes = p;
-                        char *str = stringify((openQuotes+1), (endQuotes - 1));
-                        if (str != NULL) {
-                            *pVal = str;
-                            return 0;
-                        }
-                    }
-                }
+            const char *endQuotes = jsonSkipString(openQuotes, (pObj->end + 1));
+            if (endQuotes != NULL) {
+                pView->str = openQuotes + 1;
+                pView->len = endQuotes - openQuotes - 1;
+                return 0;
             }
         }
     }
@@ -278,59 +717,518 @@ int jsonGetStringValue(const JsonObject *pObj, const char *tag, char **pVal)
     return -1;
 }
 
-// Format is: "<tag>":"<val>" where the value is a string representing
-// the time in hh:mm:ss.
-int jsonGetStrTimeValue(const JsonObject *pObj, const char *tag, time_t *pVal)
+// Format is: "<tag>":"<val>" where the value is a string
+int jsonGetStringValue(const JsonObject *pObj, const char *tag, char **pVal)
 {
-    char *value = NULL;
-    unsigned int hr, min, sec;
-    int s = 0;
+    JsonStrView view;
+    char *str;
 
-    if (jsonGetStringValue(pObj, tag, &value) != 0)
+    if ((jsonGetStringView(pObj, tag, &view) != 0) ||
+        ((str = stringify(view.str, (view.str + view.len - 1))) == NULL))
         return -1;
 
-    if (sscanf(value, "%u:%u:%u", &hr, &min, &sec) == 3) {
-        *pVal = (hr * 3600) + (min * 60) + sec;
-    } else {
-        s = -1;
+    *pVal = str;
+
+    return 0;
+}
+
+// Copy the string to the given buffer as a null-terminated
+// string, truncating it if needed.
+char *jsonStrViewCpy(const JsonStrView *pView, char *buf, size_t bufLen)
+{
+    size_t len = (pView->len < bufLen) ? pView->len : (bufLen - 1);
+
+    // An empty or missing field has no string to copy
+    if (len != 0)
+        memcpy(buf, pView->str, len);
+    buf[len] = '\0';
+
+    return buf;
+}
+
+// Powers of ten that are exactly representable as a double
+static const double jsonPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Slow path of jsonParseDouble(): let strtod() deal with
+// the number, using a null-terminated copy of it, which is
+// only allocated if the number doesn't fit in the buffer.
+static int jsonStrtod(const char *str, size_t len, double *pVal)
+{
+    char buf[128];
+    char *copy = buf;
+    char *endp;
+    double val;
+
+    if ((len >= sizeof (buf)) && ((copy = malloc(len + 1)) == NULL))
+        return -1;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    val = strtod(copy, &endp);
+    if (copy != buf)
+        free(copy);
+    if (endp == copy)
+        return -1;
+
+    *pVal = val;
+    return 0;
+}
+
+// Parse the decimal number in the first 'len' characters of
+// the string. Like sscanf("%le") the leading white space is
+// skipped and the parsing stops at the first character that
+// can't be part of the number.
+//
+// The number is parsed directly from the text into a 64-bit
+// decimal mantissa and a power of ten. When the mantissa fits
+// in the 53 bits of a double and the power of ten is exactly
+// representable (|exp| <= 22), a single multiplication or
+// division gives the correctly rounded result (Clinger's fast
+// path). That covers all the values found in the route and
+// SHIZ files; anything else is handed to strtod().
+int jsonParseDouble(const char *str, size_t len, double *pVal)
+{
+    const char *p = str;
+    const char *end = str + len;
+    uint64_t mant = 0;
+    int numDigits = 0;  // significant digits in 'mant'
+    int exp10 = 0;
+    int neg = 0;
+    int seen = 0;       // seen any digits?
+    int inexact = 0;    // dropped any non-zero digits?
+    double val;
+
+    while ((p < end) && isspace((unsigned char) *p))
+        p++;
+    str = p;
+
+    if ((p < end) && ((*p == '-') || (*p == '+'))) {
+        neg = (*p == '-');
+        p++;
     }
 
-    free(value);
+    // Integer part
+    for (; (p < end) && isdigit((unsigned char) *p); p++) {
+        int d = *p - '0';
+        seen = 1;
+        if (numDigits < 19) {
+            mant = (mant * 10) + d;
+            numDigits += (mant != 0);
+        } else {
+            exp10++;
+            inexact |= (d != 0);
+        }
+    }
 
-    return s;
+    // Fractional part
+    if ((p < end) && (*p == '.')) {
+        for (p++; (p < end) && isdigit((unsigned char) *p); p++) {
+            int d = *p - '0';
+            seen = 1;
+            if (numDigits < 19) {
+                mant = (mant * 10) + d;
+                numDigits += (mant != 0);
+                exp10--;
+            } else {
+                inexact |= (d != 0);
+            }
+        }
+    }
+
+    if (!seen) {
+        // Could be "inf", "nan", etc. The string may run to
+        // the end of the enclosing object, so only the token
+        // is handed to strtod().
+        if ((p >= end) || (strchr("iInN", *p) == NULL) || (*p == '\0'))
+            return -1;
+        while ((p < end) && !isspace((unsigned char) *p) && (strchr(",}]\"", *p) == NULL))
+            p++;
+        return jsonStrtod(str, (p - str), pVal);
+    }
+
+    // Exponent
+    if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+        const char *q = p + 1;
+        int expNeg = 0;
+        int exp = 0;
+
+        if ((q < end) && ((*q == '-') || (*q == '+'))) {
+            expNeg = (*q == '-');
+            q++;
+        }
+        if ((q < end) && isdigit((unsigned char) *q)) {
+            for (; (q < end) && isdigit((unsigned char) *q); q++) {
+                if (exp < 10000)
+                    exp = (exp * 10) + (*q - '0');
+            }
+            exp10 += expNeg ? -exp : exp;
+            p = q;
+        }
+    }
+
+    if (mant == 0) {
+        *pVal = neg ? -0.0 : 0.0;
+        return 0;
+    }
+
+    if (inexact || (mant > (1ULL << 53)) || (exp10 < -22) || (exp10 > 22))
+        return jsonStrtod(str, (p - str), pVal);
+
+    val = (double) mant;
+    val = (exp10 < 0) ? (val / jsonPow10[-exp10]) : (val * jsonPow10[exp10]);
+    *pVal = neg ? -val : val;
+
+    return 0;
+}
+
+// Parse a time value in the format hh:mm:ss
+int jsonParseTime(const char *str, size_t len, time_t *pVal)
+{
+    const char *p = str;
+    const char *end = str + len;
+    time_t val = 0;
+
+    for (int i = 0; i < 3; i++) {
+        unsigned int n = 0;
+
+        if ((i != 0) && ((p >= end) || (*p++ != ':')))
+            return -1;
+        if ((p >= end) || !isdigit((unsigned char) *p))
+            return -1;
+        for (; (p < end) && isdigit((unsigned char) *p); p++)
+            n = (n * 10) + (*p - '0');
+        val = (val * 60) + n;
+    }
+
+    *pVal = val;
+    return 0;
 }
 
 // Format is: "<tag>":"<val>" where the value is a string representing
-// a double floating point number.
-int jsonGetStrDoubleValue(const JsonObject *pObj, const char *tag, double *pVal)
+// the time in hh:mm:ss.
+int jsonGetStrTimeValue(const JsonObject *pObj, const char *tag, time_t *pVal)
 {
-    char *value = NULL;
-    int s = 0;
+    JsonStrView view;
 
-    if (jsonGetStringValue(pObj, tag, &value) != 0)
+    if (jsonGetStringView(pObj, tag, &view) != 0)
         return -1;
 
-    if (sscanf(value, "%le", pVal) != 1) {
-        s = -1;
-    }
+    return jsonParseTime(view.str, view.len, pVal);
+}
 
-    free(value);
+// Format is: "<tag>":"<val>" where the value is a string representing
+// a double floating point number.
+int jsonGetStrDoubleValue(const JsonObject *pObj, const char *tag, double *pVal)
+{
+    JsonStrView view;
 
-    return s;
+    if (jsonGetStringView(pObj, tag, &view) != 0)
+        return -1;
+
+    return jsonParseDouble(view.str, view.len, pVal);
 }
 
 // Format is: "<tag>":<double> where the value is a double float number.
 int jsonGetDoubleValue(const JsonObject *pObj, const char *tag, double *pVal)
 {
     const char *value = NULL;
-    int s = 0;
 
     if ((value = jsonFindTag(pObj, tag)) == NULL)
         return -1;
 
-    if (sscanf(value, "%le", pVal) != 1) {
-        s = -1;
+    return jsonParseDouble(value, (pObj->end - value), pVal);
+}
+
+// Format is: "<tag>":"<val>" or "<tag>":<val> where the value is
+// a double floating point number.
+int jsonGetNumberValue(const JsonObject *pObj, const char *tag, double *pVal)
+{
+    const char *value = NULL;
+
+    if (pObj->tape != NULL) {
+        const JsonTapeEnt *pEnt = jsonTapeFindTag(pObj, tag);
+
+        if (pEnt == NULL)
+            return -1;
+
+        value = pObj->tape->data + pEnt->start;
+        if (pEnt->type == jtString)
+            return jsonParseDouble((value + 1), (pEnt->end - pEnt->start - 1), pVal);
+        if (pEnt->type == jtPrim)
+            return jsonParseDouble(value, (pEnt->end - pEnt->start + 1), pVal);
+        return -1;
+    }
+
+    if ((value = jsonFindTag(pObj, tag)) == NULL)
+        return -1;
+
+    if (*value == '"') {
+        const char *endQuotes = jsonSkipString(value, (pObj->end + 1));
+        if (endQuotes == NULL)
+            return -1;
+        return jsonParseDouble((value + 1), (endQuotes - value - 1), pVal);
+    }
+
+    return jsonParseDouble(value, (pObj->end - value), pVal);
+}
+
+// Tokenize the first JSON object or array in the given data
+// block into a tape.
+int jsonTapeBuild(const char *data, size_t dataLen, JsonTape *pTape)
+{
+    const char *p = data;
+    const char *end = data + dataLen;
+    uint32_t *stack = NULL;     // indices of the open objects/arrays
+    JsonScan scan;
+    size_t depth = 0;
+    size_t maxDepth = 0;
+    int expectKey = 0;
+
+    memset(pTape, 0, sizeof (JsonTape));
+    pTape->data = data;
+
+    if (dataLen >= UINT32_MAX) {
+        fprintf(stderr, "ERROR: JSON data too large for a tape (%zu bytes)!\n", dataLen);
+        return -1;
+    }
+
+    // Skip anything before the top-level object or array;
+    // e.g. a byte-order mark.
+    while ((p < end) && (*p != '{') && (*p != '['))
+        p++;
+
+    // Jump from one structural character to the next one,
+    // picking up the primitive values that may follow the
+    // characters that precede a value. Primitive values
+    // contain no structural characters, so the scanner
+    // doesn't need to be told about them.
+    jsonScanStart(&scan, p, end);
+    while ((p = jsonScanNext(&scan)) != NULL) {
+        int c = *p;
+        int idx;
+
+        if ((c == '{') || (c == '[')) {
+            if (expectKey) {
+                // Value where a key was expected
+                break;
+            }
+            if ((idx = jsonTapeAdd(pTape, ((c == '{') ? jtObject : jtArray), p, p)) < 0)
+                break;
+            if (depth == maxDepth) {
+                uint32_t *newStack;
+                maxDepth = (maxDepth != 0) ? (maxDepth * 2) : 32;
+                if ((newStack = realloc(stack, (maxDepth * sizeof (uint32_t)))) == NULL) {
+                    fprintf(stderr, "ERROR: can't alloc JSON tape stack!\n");
+                    break;
+                }
+                stack = newStack;
+            }
+            stack[depth++] = idx;
+            expectKey = (c == '{');
+            if ((c == '[') && (jsonTapeAddPrim(pTape, p, end) != 0))
+                break;
+        } else if ((c == '}') || (c == ']')) {
+            JsonTapeEnt *pEnt;
+
+            if (depth == 0)
+                break;
+            pEnt = &pTape->ents[stack[--depth]];
+            if (pEnt->type != ((c == '}') ? jtObject : jtArray)) {
+                // Mismatched brace or bracket
+                break;
+            }
+            if (pTape->ents[pTape->numEnts - 1].type == jtKey) {
+                // Key without a value
+                break;
+            }
+            pEnt->end = p - data;
+            pEnt->next = pTape->numEnts;
+            if (depth == 0) {
+                // Done!
+                free(stack);
+                return 0;
+            }
+            expectKey = 0;
+        } else if (c == '"') {
+            const char *endQuotes;
+
+            // All the structural characters inside the
+            // string have been masked out by the scanner,
+            // so the next one is the closing quote.
+            if ((depth == 0) || ((endQuotes = jsonScanNext(&scan)) == NULL))
+                break;
+            if (jsonTapeAdd(pTape, (expectKey ? jtKey : jtString), p, endQuotes) < 0)
+                break;
+            expectKey = 0;
+        } else if (c == ',') {
+            if (depth == 0)
+                break;
+            if (pTape->ents[stack[depth - 1]].type == jtObject) {
+                expectKey = 1;
+            } else if (jsonTapeAddPrim(pTape, p, end) != 0) {
+                break;
+            }
+        } else if (c == ':') {
+            if ((depth == 0) || (jsonTapeAddPrim(pTape, p, end) != 0))
+                break;
+        }
+    }
+
+    // Malformed or truncated JSON text
+    if (p != NULL) {
+        fprintf(stderr, "ERROR: malformed JSON text at offset %zu!\n", (size_t) (p - data));
+    } else {
+        fprintf(stderr, "ERROR: truncated JSON text!\n");
     }
+    free(stack);
+    jsonTapeFree(pTape);
+
+    return -1;
+}
+
+// Call the handler for each direct member of the given object,
+// in the order they appear in the text.
+int jsonObjectForEachMember(const JsonObject *pObj, JsonMbrHdlr handler, void *arg)
+{
+    const JsonTape *pTape = pObj->tape;
+    const char *p, *end;
+    JsonMember mbr;
+
+    if (pTape != NULL) {
+        const JsonTapeEnt *pObjEnt = &pTape->ents[pObj->tapeIdx];
+
+        if (pObjEnt->type != jtObject)
+            return -1;
 
-    return s;
+        for (uint32_t n = (pObj->tapeIdx + 1); n < pObjEnt->next; n = pTape->ents[n + 1].next) {
+            const JsonTapeEnt *pKey = &pTape->ents[n];
+
+            mbr.key.str = pTape->data + pKey->start + 1;
+            mbr.key.len = pKey->end - pKey->start - 1;
+            mbr.type = pKey[1].type;
+            jsonTapeSetObj(pTape, (n + 1), &mbr.value);
+
+            if (handler(&mbr, arg) != 0)
+                return -1;
+        }
+
+        return 0;
+    }
+
+    // No tape, so walk the text of the object, skipping
+    // over the values of the members.
+    if (*pObj->start != '{')
+        return -1;
+
+    mbr.value.tape = NULL;
+    mbr.value.tapeIdx = 0;
+    end = pObj->end;
+    for (p = (pObj->start + 1); p < end; p++) {
+        const char *keyEnd, *val, *valEnd;
+
+        if (isspace((unsigned char) *p) || (*p == ','))
+            continue;
+
+        // "<key>"
+        if ((*p != '"') || ((keyEnd = jsonSkipString(p, end)) == NULL))
+            return -1;
+
+        // :
+        for (val = (keyEnd + 1); (val < end) && isspace((unsigned char) *val); val++)
+            ;
+        if ((val == end) || (*val != ':'))
+            return -1;
+        for (val++; (val < end) && isspace((unsigned char) *val); val++)
+            ;
+        if (val == end)
+            return -1;
+
+        // <value>
+        if ((*val == '{') || (*val == '[')) {
+            mbr.type = (*val == '{') ? jtObject : jtArray;
+            valEnd = jsonFindClose(val, end);
+        } else if (*val == '"') {
+            mbr.type = jtString;
+            valEnd = jsonSkipString(val, end);
+        } else {
+            mbr.type = jtPrim;
+            for (valEnd = val; ((valEnd + 1) < end) && (memchr(",}] \t\r\n", valEnd[1], 7) == NULL); valEnd++)
+                ;
+        }
+        if (valEnd == NULL)
+            return -1;
+
+        mbr.key.str = p + 1;
+        mbr.key.len = keyEnd - p - 1;
+        mbr.value.start = (char *) val;
+        mbr.value.end = (char *) valEnd;
+
+        if (handler(&mbr, arg) != 0)
+            return -1;
+
+        p = valEnd;
+    }
+
+    return 0;
+}
+
+// Get the string value of the member
+int jsonMemberStrView(const JsonMember *pMbr, JsonStrView *pView)
+{
+    const char *str = pMbr->value.start;
+    const char *end = pMbr->value.end;
+
+    if (pMbr->type == jtArray) {
+        // Use the first element of the array
+        for (str++; (str < end) && isspace((unsigned char) *str); str++)
+            ;
+        if ((str == end) || (*str != '"') || ((end = jsonSkipString(str, end)) == NULL))
+            return -1;
+    } else if (pMbr->type != jtString) {
+        return -1;
+    }
+
+    pView->str = str + 1;
+    pView->len = end - str - 1;
+
+    return 0;
+}
+
+// Get the numeric value of the member, which may be either
+// a number or a string representing a number.
+int jsonMemberDoubleValue(const JsonMember *pMbr, double *pVal)
+{
+    const char *str = pMbr->value.start;
+    size_t len = pMbr->value.end - str + 1;
+
+    if (pMbr->type == jtString)
+        return jsonParseDouble((str + 1), (len - 2), pVal);
+
+    if (pMbr->type == jtPrim)
+        return jsonParseDouble(str, len, pVal);
+
+    return -1;
+}
+
+// Get the top-level object recorded in the tape
+int jsonTapeGetRoot(const JsonTape *pTape, JsonObject *pObj)
+{
+    if ((pTape->numEnts == 0) || (pTape->ents[0].type != jtObject))
+        return -1;
+
+    jsonTapeSetObj(pTape, 0, pObj);
+
+    return 0;
+}
+
+void jsonTapeFree(JsonTape *pTape)
+{
+    free(pTape->ents);
+    pTape->ents = NULL;
+    pTape->numEnts = 0;
+    pTape->maxEnts = 0;
 }
@@ -1,17 +1,88 @@
 #pragma once
 
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
 __BEGIN_DECLS
 
+// Type of the elements recorded in a JSON tape
+typedef enum JsonTapeTyp {
+    jtObject = 1,   // {...}
+    jtArray = 2,    // [...]
+    jtKey = 3,      // "<key>" of an object member
+    jtString = 4,   // "<val>"
+    jtPrim = 5,     // number, true, false, or null
+} JsonTapeTyp;
+
+// A tape entry records the location of a structural
+// element of the JSON text, as offsets from the start
+// of the data buffer.
+typedef struct JsonTapeEnt {
+    uint32_t start; // offset of the first char: e.g. '{' or opening '"'
+    uint32_t end;   // offset of the last char: e.g. '}' or closing '"'
+    uint32_t next;  // index of the entry that follows this element's subtree
+    uint32_t type;  // JsonTapeTyp
+} JsonTapeEnt;
+
+// A JSON tape is a flat index of all the objects, arrays,
+// keys, and values of a JSON text, built by a single pass
+// over the data. The members of an object are stored as
+// key/value entry pairs following the object's entry, and
+// the 'next' index allows skipping over nested elements,
+// so looking up a key costs O(members) instead of O(bytes).
+typedef struct JsonTape {
+    const char *data;   // the JSON text
+    JsonTapeEnt *ents;  // array of tape entries
+    size_t numEnts;     // number of entries in use
+    size_t maxEnts;     // number of entries allocated
+} JsonTape;
+
 // A JSON object consists of text enclosed within matching
 // curly braces.
 typedef struct JsonObject {
     char *start;    // points to the left curly brace where the object starts
     char *end;      // points to the right curly brace where the object ends
+    const JsonTape *tape;   // tape of the JSON text, or NULL if none
+    uint32_t tapeIdx;       // index of the object's entry in the tape
 } JsonObject;
 
+// A view of a string value in the JSON text: i.e. a pointer
+// to its first character and its length, excluding the double
+// quotes. Any escape sequences are left as they are in the
+// text, so it is up to the consumer to decode them if needed.
+typedef struct JsonStrView {
+    const char *str;
+    size_t len;
+} JsonStrView;
+
+// Helpers to print a JsonStrView; e.g.
+//
+//   printf("Title: " JSON_SV_FMT "\n", JSON_SV_ARG(title));
+//
+#define JSON_SV_FMT     "%.*s"
+#define JSON_SV_ARG(v)  (int) (v).len, (v).str
+
+// A range of consecutive elements of a JSON array
+typedef struct JsonArrayPart {
+    JsonObject array;   // the array
+    JsonObject first;   // first element in the range
+    size_t numElems;    // number of elements in the range
+} JsonArrayPart;
+
 // Callback handler for the for-each iterator
 typedef int (*JsonCbHdlr)(const JsonObject *, void *);
 
+// A member of a JSON object: i.e. "<key>":<value>
+typedef struct JsonMember {
+    JsonStrView key;    // the key, without the double quotes
+    JsonTapeTyp type;   // jtObject, jtArray, jtString, or jtPrim
+    JsonObject value;   // the text of the value, including any quotes, braces, or brackets
+} JsonMember;
+
+// Callback handler for the member iterator
+typedef int (*JsonMbrHdlr)(const JsonMember *, void *);
+
 // Locate the specified tag within the given JSON object and
 // return a pointer to its value: e.g.
 //
@@ -46,9 +117,28 @@ extern int jsonFindArrayByTag(const JsonObject *pObj, const char *tag, JsonObjec
 // Process each element in the specified array
 extern int jsonArrayForEach(const JsonObject *pArray, JsonCbHdlr handler, void *arg);
 
+// Split the elements of the array into up to 'maxParts' ranges
+// of consecutive elements of about the same size, which can then
+// be processed independently (e.g. by different threads) using
+// jsonArrayPartForEach(). Returns the number of parts.
+extern int jsonArraySplit(const JsonObject *pArray, JsonArrayPart *pParts, int maxParts);
+
+// Process each element in the specified part of an array
+extern int jsonArrayPartForEach(const JsonArrayPart *pPart, JsonCbHdlr handler, void *arg);
+
 // Format is: "<tag>":"<val>" where the value is a string
 extern int jsonGetStringValue(const JsonObject *pObj, const char *tag, char **pVal);
 
+// Same as jsonGetStringValue() and jsonGetArrayValue() but
+// without making a copy of the value: the view points into
+// the JSON text, so it is only valid as long as the text is.
+extern int jsonGetStringView(const JsonObject *pObj, const char *tag, JsonStrView *pView);
+extern int jsonGetArrayView(const JsonObject *pObj, const char *tag, JsonStrView *pView);
+
+// Copy the string to the given buffer as a null-terminated
+// string, truncating it if needed.
+extern char *jsonStrViewCpy(const JsonStrView *pView, char *buf, size_t bufLen);
+
 // Format is: "<tag>":"<val>" where the value is a string representing
 // the time in hh:mm:ss.
 extern int jsonGetStrTimeValue(const JsonObject *pObj, const char *tag, time_t *pVal);
@@ -60,7 +150,55 @@ extern int jsonGetStrDoubleValue(const JsonObject *pObj, const char *tag, double
 // Format is: "<tag>":<double> where the value is a double float number.
 extern int jsonGetDoubleValue(const JsonObject *pObj, const char *tag, double *pVal);
 
+// Format is: "<tag>":"<val>" or "<tag>":<val> where the value is
+// a double floating point number.
+extern int jsonGetNumberValue(const JsonObject *pObj, const char *tag, double *pVal);
+
+// Parse the decimal number in the first 'len' characters of the
+// string, without making a copy of it. The result is correctly
+// rounded, same as strtod().
+extern int jsonParseDouble(const char *str, size_t len, double *pVal);
+
+// Parse the time value in the format hh:mm:ss in the first 'len'
+// characters of the string, and return it in seconds.
+extern int jsonParseTime(const char *str, size_t len, time_t *pVal);
+
+// Call the handler for each direct member of the given object,
+// in the order they appear in the text: e.g.
+//
+//   { "<key0>":<val0>, "<key1>":{...}, ... }
+//
+// Unlike jsonFindTag(), the members of any nested objects are
+// not visited. The member passed to the handler refers to the
+// text of the object, so nothing is allocated.
+extern int jsonObjectForEachMember(const JsonObject *pObj, JsonMbrHdlr handler, void *arg);
+
+// Get the string value of the member. As a convenience, when the
+// value is an array the first element is used; e.g.
+//
+//   "file":["Col_de_Vars-seg.shiz"]
+//
+extern int jsonMemberStrView(const JsonMember *pMbr, JsonStrView *pView);
+
+// Get the value of the member as a double floating point number.
+// The value can be either a number or a string; e.g.
+//
+//   "ele":"1876.6" or "ele":1876.6
+//
+extern int jsonMemberDoubleValue(const JsonMember *pMbr, double *pVal);
+
 extern void jsonDumpObject(const JsonObject *pObj);
 
+// Tokenize the first JSON object or array in the given data
+// block into a tape. Objects located via jsonTapeGetRoot(),
+// and any objects found from them, resolve their lookups
+// using the tape instead of scanning the text.
+extern int jsonTapeBuild(const char *data, size_t dataLen, JsonTape *pTape);
+
+// Get the top-level object recorded in the tape
+extern int jsonTapeGetRoot(const JsonTape *pTape, JsonObject *pObj);
+
+extern void jsonTapeFree(JsonTape *pTape);
+
 __END_DECLS
 
@@ -2,6 +2,8 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,16 +16,32 @@
 
 #include "args.h"
 #include "download.h"
+#include "filter.h"
 #include "json.h"
 #include "output.h"
 #include "routedb.h"
+#include "server.h"
 #include "shiz.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "strutil.h"
 
 #if (OS_TYPE == OS_TYPE_MACOS)
 #undef st_atim
 #define st_atim st_atimespec
 #endif
 
+// Max number of threads used to process the route objects
+#define MAX_THREADS 64
+
+// The allrides file, whose contents the string views of the
+// route DB refer to, unless the DB was loaded from a snapshot.
+typedef struct InFile {
+    const char *filePath;
+    char *data;
+    size_t dataLen;
+} InFile;
+
 typedef struct AllRidesFile {
     char filePath[1024];
     time_t fileDate;
@@ -128,6 +146,9 @@ static const char *help =
         "    --dry-run\n"
         "        Show what is going to be downloaded, without actually downloading\n"
         "        anything.\n"
+        "    --explain\n"
+        "        Print the plan used to apply the match filters, with the pass\n"
+        "        rate of each filter, to stderr.\n"
         "    --export-gpx\n"
         "        Export the ride as a GPX route file.\n"
         "    --get-shiz\n"
@@ -136,6 +157,13 @@ static const char *help =
         "        Download the MP4 video file of the ride at the specified resolution.\n"
         "    --help\n"
         "        Show this help and exit.\n"
+        "    --id <id>[,<id>...]\n"
+        "        Only include the rides with the specified route IDs (i.e. the \"_id\"\n"
+        "        values in the allrides file). The IDs must match exactly.\n"
+        "    --limit <num>\n"
+        "        Only include the first <num> rides. When used with \"--sort-by\" the\n"
+        "        rides are picked in the sort order; e.g. \"--sort-by -toughness\n"
+        "        --limit 20\" lists the 20 toughest rides.\n"
         "    --max-distance <value>\n"
         "        Only include rides with a distance up to the specified value.\n"
         "    --max-duration <value>\n"
@@ -155,23 +183,71 @@ static const char *help =
         "        match is case-insensitive and liberal: e.g. specifying \"cuadrado\"\n"
         "        will match the MP4 files: \"Camino-Del-Cuadrado.mp4\" and\n"
         "        \"Camino-Del-Cuadrado-Downhill.mp4\".\n"
-        "    --output-format {csv|html|text}\n"
+        "    --no-cache\n"
+        "        Don't use the snapshot of the allrides file, and don't save it. By\n"
+        "        default, the parsed routes are saved to a binary snapshot file next\n"
+        "        to the allrides file, which is used by the next runs until the\n"
+        "        allrides file changes.\n"
+        "    --no-download\n"
+        "        Don't download any files, and use the SHIZ files that are already\n"
+        "        in the download folder to export the GPX files.\n"
+        "    --output-file <path>\n"
+        "        Write the list of routes to the specified file, instead of to the\n"
+        "        standard output.\n"
+        "    --output-format {csv|html|json|text}\n"
         "        Specifies the format of the output file with the list of routes.\n"
         "        If omitted, the plain text format is used by default.\n"
         "    --province <name>\n"
         "        Only include rides from the specified province or state in the\n"
         "        specified country. The name match is case-insensitive and liberal:\n"
         "        e.g. specifying \"cali\" will match all rides from California, USA.\n"
+        "    --query-file <path>\n"
+        "        Run all the queries in the specified file, parsing the allrides file\n"
+        "        only once. Each line of the file is a query with the same filter,\n"
+        "        sort, format, and download options as the command line, including\n"
+        "        \"--output-file\" to write its list of routes to its own file; e.g.\n"
+        "        \"--country aus --output-format csv --output-file aus.csv\". Blank\n"
+        "        lines, and lines starting with '#', are ignored.\n"
+        "    --save-snapshot <path>\n"
+        "        Save a snapshot of all the rides in the library to the specified\n"
+        "        file, to be used with \"--since\" by a later run.\n"
+        "    --serve <path>\n"
+        "        Run as a daemon that loads the rides once, and answers queries on\n"
+        "        the Unix domain socket at the specified path. Each query is a line\n"
+        "        with the same filter, sort, and format options as the command line,\n"
+        "        and the list of routes is sent back on the same connection. The\n"
+        "        rides are reloaded whenever the allrides file changes.\n"
         "    --shiz <name>\n"
         "        Only include rides that have <name> in their shiz file name. The name\n"
         "        match is case-insensitive and liberal: e.g. specifying \"cuadrado\"\n"
         "        will match the shiz files: \"Camino-Del-Cuadrado-working-seg.shiz\"\n"
         "        and \"Camino-Del-Cuadrado-Downhill-working-seg.2.shiz\".\n"
+        "    --since <path>\n"
+        "        Only include the rides that were added or changed since the snapshot\n"
+        "        saved to the specified file by \"--save-snapshot\". The rides are\n"
+        "        matched by their route IDs, and a ride has changed when its info or\n"
+        "        its update time are different. The rides that have been removed are\n"
+        "        listed after the others, and the output includes the status of\n"
+        "        each ride: \"added\", \"changed\", or \"removed\".\n"
+        "    --sort-by <key>[,<key>...]\n"
+        "        Sort the rides by the specified keys, in order of precedence. The\n"
+        "        supported keys are: contributor, country, distance, duration,\n"
+        "        elevation, province, title, toughness, updated, and views. A key\n"
+        "        prefixed with '-' is sorted in descending order; e.g. specifying\n"
+        "        \"country,-elevation\" lists the rides by country, and the ones from\n"
+        "        the same country from the highest to the lowest elevation gain.\n"
+        "        If omitted, the rides are listed in the order of the allrides file.\n"
+        "    --threads <num>\n"
+        "        Use the specified number of threads to process the route records in\n"
+        "        the allrides file. This speeds up the processing of large libraries\n"
+        "        on multi-core machines. If omitted, a single thread is used.\n"
         "    --title <name>\n"
         "        Only include rides that have <name> in their title. The name\n"
         "        match is case-insensitive and liberal: e.g. specifying \"gavia\"\n"
         "        will match the rides \"Passo di Gavia\", \"Passo di Gavia Sweet\n"
-        "        Spot\", and \"Passo di Gavia from Ponte di Legno\".\n"
+        "        Spot\", and \"Passo di Gavia from Ponte di Legno\". The accents\n"
+        "        are also ignored: e.g. \"etape\" will match \"Étape du Tour\", and\n"
+        "        \"zurich\" will match \"Zürich\".\n"
         "    --units {imperial|metric}\n"
         "        Specifies the system of units to use to represent the input/output\n"
         "        data: \"imperial\" uses feet and miles, while \"metric\" uses meters\n"
@@ -181,7 +257,9 @@ static const char *help =
         "\n"
         "NOTES:\n"
         "    The specified min/max distance values and min/man elevation gain values\n"
-        "    are interpreted based on the value of the \"--units\" option.\n"
+        "    are interpreted based on the value of the \"--units\" option. The min/max\n"
+        "    values can have decimals (e.g. \"--max-distance 15.5\"), and they are\n"
+        "    compared against the exact values of the rides.\n"
         "\n"
         "    Running the tool under Windows/Cygwin the drive letters are replaced by\n"
         "    their equivalent cygdrive: e.g. the path \"C:\\Users\\Marcelo\\Documents\"\n"
@@ -190,15 +268,13 @@ static const char *help =
         "BUGS:\n"
         "    Report bugs and enhancement requests to: marcelo_mourier@yahoo.com\n";
 
-static int parseDistanceVal(const char *str, int *val, Units units)
+static int parseDistanceVal(const char *str, double *val, Units units)
 {
-    int value;
+    double value;
 
-    if (sscanf(str, "%d", &value) == 1) {
+    if (sscanf(str, "%lf", &value) == 1) {
         if (units == imperial) {
-            value = value * 1609;   // Convert miles to meters
-        } else {
-            value = value * 1000;   // Convert kilometers to meters
+            value = value * 1.609344;   // Convert miles to kilometers
         }
         *val = value;
         return 0;
@@ -207,15 +283,13 @@ static int parseDistanceVal(const char *str, int *val, Units units)
     return -1;
 }
 
-static int parseElevGainVal(const char *str, int *val, Units units)
+static int parseElevGainVal(const char *str, double *val, Units units)
 {
-    int value;
+    double value;
 
-    if (sscanf(str, "%d", &value) == 1) {
+    if (sscanf(str, "%lf", &value) == 1) {
         if (units == imperial) {
-            value = value * 305;    // Convert feet to millimeters
-        } else {
-            value = value * 1000;   // Convert meters to millimeters
+            value = value * 0.3048;     // Convert feet to meters
         }
         *val = value;
         return 0;
@@ -224,15 +298,124 @@ static int parseElevGainVal(const char *str, int *val, Units units)
     return -1;
 }
 
-static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
+// Parse the comma-separated list of sort keys; e.g.
+// "distance,-elevation,title". A leading '-' sorts the
+// key in descending order.
+static int parseSortKeys(const char *str, CmdArgs *pArgs)
+{
+    static const struct {
+        const char *name;
+        SortFld fld;
+    } sortFlds[] = {
+        { "contributor", sortContributor },
+        { "country", sortCountry },
+        { "distance", sortDistance },
+        { "duration", sortDuration },
+        { "elevation", sortElevation },
+        { "province", sortProvince },
+        { "title", sortTitle },
+        { "toughness", sortToughness },
+        { "updated", sortUpdated },
+        { "views", sortViews },
+    };
+    const char *p = str;
+
+    pArgs->numSortKeys = 0;
+
+    do {
+        SortKey *pKey = &pArgs->sortKeys[pArgs->numSortKeys];
+        size_t len;
+        int n;
+
+        if (pArgs->numSortKeys == MAX_SORT_KEYS)
+            return -1;
+
+        pKey->desc = (*p == '-');
+        if ((*p == '-') || (*p == '+'))
+            p++;
+
+        len = strcspn(p, ",");
+        for (n = 0; n < (sizeof (sortFlds) / sizeof (sortFlds[0])); n++) {
+            if ((strlen(sortFlds[n].name) == len) && (strncmp(sortFlds[n].name, p, len) == 0))
+                break;
+        }
+        if (n == (sizeof (sortFlds) / sizeof (sortFlds[0])))
+            return -1;
+
+        pKey->fld = sortFlds[n].fld;
+        pArgs->numSortKeys++;
+        p += len;
+    } while (*p++ == ',');
+
+    return 0;
+}
+
+// Normalize the value of a liberal match filter in place, so
+// it can be matched against the normalized fields of the routes
+static const char *normArg(char *arg)
+{
+    arg[strNorm(arg, strlen(arg), 0, arg)] = '\0';
+
+    return arg;
+}
+
+// Options that take a value
+static const char *valueOpts[] = {
+    "--allrides-file",
+    "--category",
+    "--contributor",
+    "--country",
+    "--download-folder",
+    "--get-video",
+    "--id",
+    "--limit",
+    "--max-distance",
+    "--max-duration",
+    "--max-elevation-gain",
+    "--min-distance",
+    "--min-duration",
+    "--min-elevation-gain",
+    "--mp4",
+    "--output-file",
+    "--output-format",
+    "--province",
+    "--query-file",
+    "--save-snapshot",
+    "--serve",
+    "--shiz",
+    "--since",
+    "--sort-by",
+    "--threads",
+    "--title",
+    "--units",
+};
+
+static int isValueOpt(const char *arg)
+{
+    for (int n = 0; n < (sizeof (valueOpts) / sizeof (valueOpts[0])); n++) {
+        if (strcmp(arg, valueOpts[n]) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+// Parse the options, and report any error to errFp: stderr
+// for the command line, or the response stream of a query.
+static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs, FILE *errFp)
 {
     int numArgs = argc - 1;
 
-    pArgs->maxDistance = INT_MIN;
-    pArgs->maxElevGain = INT_MIN;
-    pArgs->minDistance = INT_MAX;
-    pArgs->minElevGain = INT_MAX;
+    // The min/max values are unbounded by default
+    pArgs->maxDistance = INFINITY;
+    pArgs->maxDuration = INFINITY;
+    pArgs->maxElevGain = INFINITY;
+    pArgs->minDistance = -INFINITY;
+    pArgs->minDuration = -INFINITY;
+    pArgs->minElevGain = -INFINITY;
+    pArgs->numThreads = 1;
     pArgs->units = metric;
+    pArgs->outFile = stdout;
 
     for (int n = 1; n <= numArgs; n++) {
         const char *arg;
@@ -240,6 +423,11 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
 
         arg = argv[n];
 
+        if ((n == numArgs) && isValueOpt(arg)) {
+            fprintf(errFp, "Missing value for option: %s\n", arg);
+            return -1;
+        }
+
         if (strcmp(arg, "--help") == 0) {
             fprintf(stdout, "%s\n", help);
             exit(0);
@@ -249,17 +437,19 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
         } else if (strcmp(arg, "--allrides-file") == 0) {
             pArgs->inFile = argv[++n];
         } else if (strcmp(arg, "--category") == 0) {
-            pArgs->category = argv[++n];                        
+            pArgs->category = normArg(argv[++n]);                        
         } else if (strcmp(arg, "--contributor") == 0) {
-            pArgs->contributor = argv[++n];            
+            pArgs->contributor = normArg(argv[++n]);            
         } else if (strcmp(arg, "--country") == 0) {
-            pArgs->country = argv[++n];
+            pArgs->country = normArg(argv[++n]);
         } else if (strcmp(arg, "--download-folder") == 0) {
             pArgs->dlFolder = argv[++n];
         } else if (strcmp(arg, "--download-progress") == 0) {
             pArgs->dlProg = 1;
         } else if (strcmp(arg, "--dry-run") == 0) {
             pArgs->dryRun = 1;
+        } else if (strcmp(arg, "--explain") == 0) {
+            pArgs->explain = 1;
         } else if (strcmp(arg, "--export-gpx") == 0) {
             pArgs->expGpx = 1;
         } else if (strcmp(arg, "--get-shiz") == 0) {
@@ -276,65 +466,102 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
                        (strcmp(val, "4K") == 0)) {
                 pArgs->getVideo = res4K;
             } else {
-                fprintf(stderr, "Invalid video resolution: %s\n", val);
+                fprintf(errFp, "Invalid video resolution: %s\n", val);
+                return -1;
+            }
+        } else if (strcmp(arg, "--id") == 0) {
+            pArgs->ids = argv[++n];
+        } else if (strcmp(arg, "--limit") == 0) {
+            val = argv[++n];
+            if ((sscanf(val, "%d", &pArgs->limit) != 1) || (pArgs->limit < 1)) {
+                fprintf(errFp, "Invalid limit: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--max-distance") == 0) {
             val = argv[++n];
             if (parseDistanceVal(val, &pArgs->maxDistance, pArgs->units) != 0) {
-                fprintf(stderr, "Invalid max distance value: %s\n", val);
+                fprintf(errFp, "Invalid max distance value: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--max-duration") == 0) {
             val = argv[++n];
-            if (sscanf(val, "%d", &pArgs->maxDuration) != 1) {
-                fprintf(stderr, "Invalid max duration value: %s\n", val);
+            if (sscanf(val, "%lf", &pArgs->maxDuration) != 1) {
+                fprintf(errFp, "Invalid max duration value: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--max-elevation-gain") == 0) {
             val = argv[++n];
             if (parseElevGainVal(val, &pArgs->maxElevGain, pArgs->units) != 0) {
-                fprintf(stderr, "Invalid max elevation gain value: %s\n", val);
+                fprintf(errFp, "Invalid max elevation gain value: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--min-distance") == 0) {
             val = argv[++n];
             if (parseDistanceVal(val, &pArgs->minDistance, pArgs->units) != 0) {
-                fprintf(stderr, "Invalid min distance value: %s\n", val);
+                fprintf(errFp, "Invalid min distance value: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--min-duration") == 0) {
             val = argv[++n];
-            if (sscanf(val, "%d", &pArgs->minDuration) != 1) {
-                fprintf(stderr, "Invalid min duration value: %s\n", val);
+            if (sscanf(val, "%lf", &pArgs->minDuration) != 1) {
+                fprintf(errFp, "Invalid min duration value: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--min-elevation-gain") == 0) {
             val = argv[++n];
             if (parseElevGainVal(val, &pArgs->minElevGain, pArgs->units) != 0) {
-                fprintf(stderr, "Invalid min elevation gain value: %s\n", val);
+                fprintf(errFp, "Invalid min elevation gain value: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--mp4") == 0) {
-            pArgs->mp4 = argv[++n];
+            pArgs->mp4 = normArg(argv[++n]);
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            pArgs->noCache = 1;
+        } else if (strcmp(arg, "--no-download") == 0) {
+            pArgs->noDownload = 1;
+        } else if (strcmp(arg, "--output-file") == 0) {
+            pArgs->outPath = argv[++n];
         } else if (strcmp(arg, "--output-format") == 0) {
             val = argv[++n];
             if (strcmp(val, "csv") == 0) {
                 pArgs->outFmt = csv;
             } else if (strcmp(val, "html") == 0) {
                 pArgs->outFmt = html;
+            } else if (strcmp(val, "json") == 0) {
+                pArgs->outFmt = json;
             } else if (strcmp(val, "text") == 0) {
                 pArgs->outFmt = text;
             } else {
-                fprintf(stderr, "Invalid output format: %s\n", val);
+                fprintf(errFp, "Invalid output format: %s\n", val);
                 return -1;
             }
         } else if (strcmp(arg, "--province") == 0) {
-            pArgs->province = argv[++n];
+            pArgs->province = normArg(argv[++n]);
+        } else if (strcmp(arg, "--query-file") == 0) {
+            pArgs->queryFile = argv[++n];
+        } else if (strcmp(arg, "--save-snapshot") == 0) {
+            pArgs->saveSnap = argv[++n];
+        } else if (strcmp(arg, "--serve") == 0) {
+            pArgs->serveSock = argv[++n];
         } else if (strcmp(arg, "--shiz") == 0) {
-            pArgs->shiz = argv[++n];
+            pArgs->shiz = normArg(argv[++n]);
+        } else if (strcmp(arg, "--since") == 0) {
+            pArgs->since = argv[++n];
+        } else if (strcmp(arg, "--sort-by") == 0) {
+            val = argv[++n];
+            if (parseSortKeys(val, pArgs) != 0) {
+                fprintf(errFp, "Invalid sort keys: %s\n", val);
+                return -1;
+            }
+        } else if (strcmp(arg, "--threads") == 0) {
+            val = argv[++n];
+            if ((sscanf(val, "%d", &pArgs->numThreads) != 1) ||
+                (pArgs->numThreads < 1) || (pArgs->numThreads > MAX_THREADS)) {
+                fprintf(errFp, "Invalid number of threads: %s\n", val);
+                return -1;
+            }
         } else if (strcmp(arg, "--title") == 0) {
-            pArgs->title = argv[++n];
+            pArgs->title = normArg(argv[++n]);
         } else if (strcmp(arg, "--units") == 0) {
             val = argv[++n];
             if (strcmp(val, "imperial") == 0) {
@@ -342,26 +569,26 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
             } else if (strcmp(val, "metric") == 0) {
                 pArgs->units = metric;
             } else {
-                fprintf(stderr, "Invalid units system: %s\n", val);
+                fprintf(errFp, "Invalid units system: %s\n", val);
                 return -1;
             }
         } else {
-            fprintf(stderr, "Invalid option: %s\n", arg);
+            fprintf(errFp, "Invalid option: %s\n", arg);
             return -1;
         }
     }
 
     // Sanity check the min/max values
-    if ((pArgs->maxDistance != INT_MIN) && (pArgs->minDistance != INT_MAX) && (pArgs->minDistance > pArgs->maxDistance)) {
-        fprintf(stderr, "The minimum distance can't be greater than the maximum distance\n");
+    if (pArgs->minDistance > pArgs->maxDistance) {
+        fprintf(errFp, "The minimum distance can't be greater than the maximum distance\n");
         return -1;
     }
-    if ((pArgs->maxDuration != 0) && (pArgs->minDuration > pArgs->maxDuration)) {
-        fprintf(stderr, "The minimum duration can't be greater than the maximum duration\n");
+    if (pArgs->minDuration > pArgs->maxDuration) {
+        fprintf(errFp, "The minimum duration can't be greater than the maximum duration\n");
         return -1;
     }
-    if ((pArgs->maxElevGain != INT_MIN) && (pArgs->minElevGain != INT_MAX) && (pArgs->minElevGain > pArgs->maxElevGain)) {
-        fprintf(stderr, "The minimum elevation gain can't be greater than the maximum elevation gain\n");
+    if (pArgs->minElevGain > pArgs->maxElevGain) {
+        fprintf(errFp, "The minimum elevation gain can't be greater than the maximum elevation gain\n");
         return -1;
     }
 
@@ -369,7 +596,7 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
         // Make sure the allrides file exists
         struct stat stBuf = {0};
         if ((stat(pArgs->inFile, &stBuf) != 0) || !S_ISREG(stBuf.st_mode)) {
-            fprintf(stderr, "Invalid allrides folder: %s\n", pArgs->inFile);
+            fprintf(errFp, "Invalid allrides folder: %s\n", pArgs->inFile);
             return -1;
         }
     }
@@ -378,7 +605,7 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
         // Make sure the download folder exists
         struct stat stBuf = {0};
         if ((stat(pArgs->dlFolder, &stBuf) != 0) || !S_ISDIR(stBuf.st_mode)) {
-            fprintf(stderr, "Invalid download folder: %s\n", pArgs->dlFolder);
+            fprintf(errFp, "Invalid download folder: %s\n", pArgs->dlFolder);
             return -1;
         }
     } else {
@@ -390,7 +617,7 @@ static int parseCmdArgs(int argc, char *argv[], CmdArgs *pArgs)
         // Omitting the output file format is only
         // allowed when downloading the video or
         // the shiz files.
-        //fprintf(stderr, "INFO: Output file format not specified; using plain text by default.\n");
+        //fprintf(errFp, "INFO: Output file format not specified; using plain text by default.\n");
         pArgs->outFmt = text;
     }
 
@@ -502,271 +729,561 @@ static int getFilePath(const char *appInstDir, OsTyp osTyp, AllRidesFile *allRid
     return -1;
 }
 
-// Cygwin doesn't have this one
-static char *stristr(const char *s1, const char *s2 )
+// DB index of the n-th route to filter
+#define RT_ID(n)    ((ids != NULL) ? ids[n] : (first + (n)))
+
+// Intersect the sorted route lists, leaving the result
+// in the first list, and return its length.
+static int intersectLists(int *list1, int num1, const int *list2, int num2)
 {
-    const char *p1 = s1 ;
-    const char *p2 = s2 ;
-    const char *r = *p2 == 0 ? s1 : 0 ;
+    int n1 = 0, n2 = 0, num = 0;
 
-    while ((*p1 != 0) && (*p2 != 0)) {
-        if (tolower(*p1) == tolower(*p2)) {
-            if (r == 0) {
-                r = p1;
-            }
-            p2++;
+    while ((n1 < num1) && (n2 < num2)) {
+        if (list1[n1] < list2[n2]) {
+            n1++;
+        } else if (list1[n1] > list2[n2]) {
+            n2++;
         } else {
-            p2 = s2;
-            if (r != 0) {
-                p1 = r + 1;
-            }
-
-            if (tolower(*p1) == tolower(*p2)) {
-                r = p1;
-                p2++;
-            } else {
-                r = 0;
-            }
+            list1[num++] = list1[n1];
+            n1++;
+            n2++;
         }
-
-        p1++;
     }
 
-    return (*p2 == 0) ? (char *) r : NULL;
+    return num;
 }
 
-static int applyMatchFilters(const RouteInfo *pInfo, const CmdArgs *pArgs)
+// Add the route list to the candidates, intersecting it
+// with the current ones, if any.
+static int addCandidates(int **pCands, int numCands, int *list, int num)
 {
-    if ((pArgs->category != NULL) && (stristr(pInfo->categories, pArgs->category) == NULL)) {
-        // Ignore this ride...
-        return -1;
-    }
-    if ((pArgs->contributor != NULL) && (stristr(pInfo->contributor, pArgs->contributor) == NULL)) {
-        // Ignore this ride...
-        return -1;
+    if (*pCands == NULL) {
+        *pCands = list;
+        return num;
     }
-    if ((pArgs->country != NULL) && (stristr(pInfo->location, pArgs->country) == NULL)) {
-        // Ignore this ride...
-        return -1;
-    }
-    if ((pArgs->mp4 != NULL) && (stristr(pInfo->vim1080, pArgs->mp4) == NULL)) {
-        // Ignore this ride...
-        return -1;
-    }
-    if ((pArgs->province != NULL) && (stristr(pInfo->location, pArgs->province) == NULL)) {
-        // Ignore this ride...
-        return -1;
-    }
-    if ((pArgs->shiz != NULL) && (stristr(pInfo->shiz, pArgs->shiz) == NULL)) {
-        // Ignore this ride...
+
+    numCands = intersectLists(*pCands, numCands, list, num);
+    free(list);
+
+    return numCands;
+}
+
+// Get the bitmap of the routes whose values are within the
+// range, using the range index of the field; if a bitmap is
+// already set, it's intersected with it.
+static int rangeCandidates(const RouteDB *pDb, RtRngFld fld, double min, double max, uint64_t **pBits)
+{
+    size_t numWords = (pDb->numRecs / 64) + 1;
+    uint64_t *bits;
+    const int *ids;
+    int num;
+
+    if ((bits = calloc(numWords, sizeof (uint64_t))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc route bitmap!\n");
         return -1;
     }
-    if ((pArgs->title != NULL) && (stristr(pInfo->title, pArgs->title) == NULL)) {
-        // Ignore this ride...
-        return -1;
+
+    num = rtDbRangeLookup(pDb, fld, min, max, &ids);
+    for (int n = 0; n < num; n++) {
+        int id = ids[n];
+        if ((id >= 0) && (id < pDb->numRecs))
+            bits[id / 64] |= (uint64_t) 1 << (id % 64);
     }
-    {
-        int distance = atoi(pInfo->distance) * 1000;    // distance in meters
-        if ((pArgs->maxDistance != INT_MIN) && (distance > pArgs->maxDistance)) {
-            // Ignore this ride...
-            return -1;
-        }
-        if ((pArgs->minDistance != INT_MAX) && (distance < pArgs->minDistance)) {
-            // Ignore this ride...
-            return -1;
+
+    if (*pBits != NULL) {
+        for (size_t w = 0; w < numWords; w++) {
+            bits[w] &= (*pBits)[w];
         }
+        free(*pBits);
     }
-    {
-        int duration = pInfo->time / 60;
-        if ((pArgs->maxDuration != 0) && (duration > pArgs->maxDuration)) {
-            // Ignore this ride...
+    *pBits = bits;
+
+    return 0;
+}
+
+// Use the indexes of the DB to get the sorted list of the
+// candidate routes for the filters on the indexed fields: the
+// inverted and range indexes give the exact routes that match,
+// while the trigram indexes give the routes that may match,
+// which still need to be checked. If none of these filters is
+// used, *pList is set to NULL. Returns the number of candidates,
+// or -1 on error.
+static int lookupIndexes(const RouteDB *pDb, const CmdArgs *pArgs, int **pList)
+{
+    const struct {
+        RtIdxFld fld;
+        const char *query;
+    } lookups[] = {
+        { rifCategories, pArgs->category },
+        { rifContributor, pArgs->contributor },
+        { rifLocation, pArgs->country },
+        { rifLocation, pArgs->province },
+    };
+    const struct {
+        RtTriFld fld;
+        const char *query;
+    } triLookups[] = {
+        { rtrTitle, pArgs->title },
+        { rtrVim1080, pArgs->mp4 },
+        { rtrShiz, pArgs->shiz },
+    };
+    const struct {
+        RtRngFld fld;
+        double min;
+        double max;
+    } rngLookups[] = {
+        { rrgDistance, pArgs->minDistance, pArgs->maxDistance },
+        { rrgDuration, pArgs->minDuration * 60, pArgs->maxDuration * 60 },
+        { rrgElevation, pArgs->minElevGain, pArgs->maxElevGain },
+    };
+    uint64_t *bits = NULL;
+    int *cands = NULL;
+    int numCands = pDb->numRecs;
+
+    for (int n = 0; n < (sizeof (lookups) / sizeof (lookups[0])); n++) {
+        int *list;
+        int num;
+
+        if (lookups[n].query == NULL)
+            continue;
+
+        if ((num = rtDbIdxLookup(pDb, lookups[n].fld, lookups[n].query, &list)) < 0) {
+            free(cands);
             return -1;
         }
-        if ((pArgs->minDuration != 0) && (duration < pArgs->minDuration)) {
-            // Ignore this ride...
+
+        numCands = addCandidates(&cands, numCands, list, num);
+    }
+
+    for (int n = 0; n < (sizeof (triLookups) / sizeof (triLookups[0])); n++) {
+        int *list;
+        int num;
+
+        if (triLookups[n].query == NULL)
+            continue;
+
+        if ((num = rtDbTriLookup(pDb, triLookups[n].fld, triLookups[n].query, &list)) < 0) {
+            free(cands);
             return -1;
         }
+
+        // Short queries can't use the index
+        if (list != NULL)
+            numCands = addCandidates(&cands, numCands, list, num);
     }
-    {
-        int elevation = atoi(pInfo->elevation) * 1000;  // elevation gain in millimeters
-        if ((pArgs->maxElevGain != INT_MIN) && (elevation > pArgs->maxElevGain)) {
-            // Ignore this ride...
+
+    for (int n = 0; n < (sizeof (rngLookups) / sizeof (rngLookups[0])); n++) {
+        if ((rngLookups[n].min == -INFINITY) && (rngLookups[n].max == INFINITY))
+            continue;
+
+        if (rangeCandidates(pDb, rngLookups[n].fld, rngLookups[n].min, rngLookups[n].max, &bits) != 0) {
+            free(bits);
+            free(cands);
             return -1;
         }
-        if ((pArgs->minElevGain != INT_MAX) && (elevation < pArgs->minElevGain)) {
-            // Ignore this ride...
-            return -1;
+    }
+
+    // Keep the candidates that are in the ranges or, if
+    // there are none yet, take all the routes in them.
+    if (bits != NULL) {
+        if (cands == NULL) {
+            if ((cands = malloc((pDb->numRecs + 1) * sizeof (int))) == NULL) {
+                fprintf(stderr, "ERROR: failed to alloc route list!\n");
+                free(bits);
+                return -1;
+            }
+            numCands = 0;
+            for (int id = 0; id < pDb->numRecs; id++) {
+                if (bits[id / 64] & ((uint64_t) 1 << (id % 64)))
+                    cands[numCands++] = id;
+            }
+        } else {
+            int num = 0;
+            for (int n = 0; n < numCands; n++) {
+                int id = cands[n];
+                if (bits[id / 64] & ((uint64_t) 1 << (id % 64)))
+                    cands[num++] = id;
+            }
+            numCands = num;
         }
+        free(bits);
     }
 
-    return 0;
-}
+    *pList = cands;
 
-static void strShiftLeft(char *str, size_t count)
-{
-    size_t len = strlen(str) + 1;
-    memmove(str, (str+count), (len - count));
+    return numCands;
 }
 
-static void cleanUpDescription(char *desc)
+// Add the routes that matched the filters to the list of
+// selected routes, in their original order.
+static void selectRoutes(RouteDB *pDb, const int *ids, int count, const uint8_t *match)
 {
-    char *p;
+    const int first = 0;
 
-    p = desc;
-    while ((p = strstr(p, "\\\"")) != NULL) {
-        strShiftLeft(p, 1);
-    }
-
-    p = desc;
-    while ((p = strstr(p, "\\n")) != NULL) {
-        strShiftLeft(p, 2);
+    for (int n = 0; n < count; n++) {
+        if (match[n])
+            rtDbSelect(pDb, RT_ID(n));
     }
 }
 
 typedef struct CbInfo {
     RouteDB *routeDb;
-    const CmdArgs *cmdArgs;
+    int index;      // DB index of the next route
+    int extract;    // only extract the fields (see fltApplyLazy())
 } CbInfo;
 
 static int procRouteObj(const JsonObject *pRoute, void *arg)
 {
     CbInfo *pInfo = arg;
-    RouteDB *pDb = pInfo->routeDb;
-    const CmdArgs *pArgs = pInfo->cmdArgs;
-	RouteInfo info = {0};
+    int s;
 
 	//jsonDumpObject(pRoute);
 
-	if (jsonGetStringValue(pRoute, "_id", &info.id) != 0) {
-		fprintf(stderr, "ERROR: failed to get \"_id\" value!\n");
-		return -1;
-	}
+	if (pInfo->extract)
+	    s = rtDbExtractRoute(pInfo->routeDb, pInfo->index++, pRoute);
+	else
+	    s = rtDbParseRoute(pInfo->routeDb, pInfo->index++, pRoute);
 
-	if (jsonGetStringValue(pRoute, "t", &info.title) != 0) {
-		fprintf(stderr, "ERROR: failed to get \"t\" value!\n");
-		return -1;
+	if (s != 0) {
+	    // Error already printed
+	    return -1;
 	}
 
-	// Get the "meta" object
-	{
-		JsonObject metaObj = {0};
-
-		if (jsonFindObjByTag(pRoute, "meta", &metaObj) == 0) {
-			if (jsonGetStringValue(&metaObj, "loc", &info.location) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"meta\" value!\n");
-				return -1;
-			}
-
-			// Duration
-			if (jsonGetStringValue(&metaObj, "dur", &info.duration) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"dur\" value!\n");
-				return -1;
-			}
-
-			// Distance in kilometers
-            if (jsonGetStringValue(&metaObj, "dis", &info.distance) != 0) {
-                fprintf(stderr, "ERROR: failed to get \"dis\" value!\n");
-                return -1;
-            }
+	return 0;
+}
 
-            // Description
-            if (jsonGetStringValue(&metaObj, "des", &info.description) != 0) {
-                fprintf(stderr, "ERROR: failed to get \"des\" value!\n");
-                return -1;
+typedef struct IngestThread {
+    pthread_t tid;
+    JsonArrayPart part;     // route objects to process
+    int first;              // DB index of the first route
+    RouteDB *routeDb;
+    FltPlan plan;           // filter plan of the thread
+    uint8_t *match;         // match flags of the routes, if filtering
+    int status;
+} IngestThread;
+
+static void *ingestThread(void *arg)
+{
+    IngestThread *pThr = arg;
+    CbInfo cbInfo = { .routeDb = pThr->routeDb, .index = pThr->first, .extract = (pThr->match != NULL) };
+    RtNormBuf normBuf;
+
+    pThr->status = jsonArrayPartForEach(&pThr->part, procRouteObj, &cbInfo);
+
+    if (pThr->status != 0)
+        return NULL;
+
+    // When filtering, the plan is pushed into the parser, so
+    // the routes that don't match are only parsed as far as
+    // needed to rule them out.
+    if (pThr->match != NULL) {
+        if ((pThr->status = rtDbNormBufAlloc(pThr->routeDb, pThr->first, pThr->part.numElems, &normBuf)) == 0)
+            fltApplyLazy(pThr->routeDb, &pThr->plan, &normBuf, pThr->first, pThr->part.numElems, &pThr->match[pThr->first]);
+    } else {
+        pThr->status = rtDbNormRoutes(pThr->routeDb, pThr->first, pThr->part.numElems);
+    }
+
+    return NULL;
+}
+
+// Process the route objects in the "data" array. The array is
+// split into consecutive parts, one per thread, and since the
+// number of routes in each part is known up front, each thread
+// stores its routes directly into its own range of the DB, and,
+// if requested, then applies the match filters to them. The
+// routes that match are then added to the list in their original
+// order, so the result is the same as processing the whole array
+// in a single thread.
+static int procRouteArray(const JsonObject *pData, RouteDB *pDb, const CmdArgs *pArgs, int filter)
+{
+    IngestThread thr[MAX_THREADS];
+    JsonArrayPart parts[MAX_THREADS];
+    uint8_t *match = NULL;
+    int numParts;
+    int numRecs = 0;
+    int s = 0;
+
+    numParts = jsonArraySplit(pData, parts, pArgs->numThreads);
+
+    for (int n = 0; n < numParts; n++) {
+        numRecs += parts[n].numElems;
+    }
+
+    if ((rtDbAlloc(pDb, numRecs) != 0) || (filter && ((match = malloc(numRecs + 1)) == NULL))) {
+        fprintf(stderr, "ERROR: failed to alloc route DB!\n");
+        return -1;
+    }
+
+    for (int n = 0, first = 0; n < numParts; n++) {
+        IngestThread *pThr = &thr[n];
+
+        pThr->part = parts[n];
+        pThr->first = first;
+        pThr->routeDb = pDb;
+        pThr->match = match;
+        pThr->status = 0;
+        first += parts[n].numElems;
+
+        // Each thread adapts its own copy of the plan to
+        // the routes in its part.
+        if (filter)
+            fltCompile(&pThr->plan, pArgs, 0);
+
+        if ((n == 0) || (pthread_create(&pThr->tid, NULL, ingestThread, pThr) != 0)) {
+            // Process this part in the main thread
+            pThr->tid = pthread_self();
+        }
+    }
+
+    // Process the first part, and any other parts for
+    // which a thread couldn't be created, while the rest
+    // of the threads are busy.
+    for (int n = 0; n < numParts; n++) {
+        if (pthread_equal(thr[n].tid, pthread_self()))
+            ingestThread(&thr[n]);
+    }
+
+    for (int n = 0; n < numParts; n++) {
+        IngestThread *pThr = &thr[n];
+
+        if (!pthread_equal(pThr->tid, pthread_self()))
+            pthread_join(pThr->tid, NULL);
+
+        if (pThr->status != 0)
+            s = -1;
+    }
+
+    if ((s == 0) && filter) {
+        selectRoutes(pDb, NULL, numRecs, match);
+
+        if (pArgs->explain) {
+            for (int n = 1; n < numParts; n++) {
+                fltMerge(&thr[0].plan, &thr[n].plan);
             }
+            fltExplain(&thr[0].plan, stderr);
+        }
+    }
 
-            // Elevation gain in meters
-			if (jsonGetStringValue(&metaObj, "ele", &info.elevation) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"ele\" value!\n");
-				return -1;
-			}
-
-			// Contributor
-			if (jsonGetStringValue(&metaObj, "con", &info.contributor) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"con\" value!\n");
-				return -1;
-			}
-
-			// Toughness
-			if (jsonGetStringValue(&metaObj, "tou", &info.toughness) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"tou\" value!\n");
-				return -1;
-			}
-
-			// Categories
-			if (jsonGetArrayValue(&metaObj, "cat", &info.categories) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"cat\" value!\n");
-				return -1;
-			}
-
-			// Convert the duration to seconds
-			{
-			    int h, m, s;
-			    sscanf(info.duration, "%u:%u:%u", &h, &m, &s);
-			    info.time = (h * 3600) + (m * 60) + s;
-			}
-		}
-	}
+    free(match);
 
-	// Get the "vimXXX" objects
-	{
-		JsonObject vimObj = {0};
-
-		if (jsonFindObjByTag(pRoute, "vimMaster", &vimObj) == 0) {
-			if (jsonGetStringValue(&vimObj, "file", &info.vimMaster) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"file\" value!\n");
-				return -1;
-			}
-		}
-
-		if (jsonFindObjByTag(pRoute, "vim1080", &vimObj) == 0) {
-			if (jsonGetStringValue(&vimObj, "file", &info.vim1080) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"file\" value!\n");
-				return -1;
-			}
-		}
-
-		if (jsonFindObjByTag(pRoute, "vim720", &vimObj) == 0) {
-			if (jsonGetStringValue(&vimObj, "file", &info.vim720) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"file\" value!\n");
-				return -1;
-			}
-		}
-	}
+    return s;
+}
 
-	// Get the "a" object
-	{
-		JsonObject aObj = {0};
-
-		if (jsonFindObjByTag(pRoute, "a", &aObj) == 0) {
-		    // SHIZ control file
-			if (jsonGetStringValue(&aObj, "file", &info.shiz) != 0) {
-				fprintf(stderr, "ERROR: failed to get \"file\" value!\n");
-				return -1;
-			}
-		}
-	}
+static int cmpInt(const void *a, const void *b)
+{
+    int i1 = *(const int *) a;
+    int i2 = *(const int *) b;
 
-	if (applyMatchFilters(&info, pArgs) == 0) {
-		RouteInfo *pRoute;
+    return (i1 > i2) - (i1 < i2);
+}
 
-		// Clean up the description string
-		cleanUpDescription(info.description);
+// Look up the routes with the IDs of the "--id" option in
+// the hash index of the IDs, and return them as a sorted list
+// in *pList. Unknown IDs are ignored. Returns the number of
+// routes, or -1 on error.
+static int lookupIds(const RouteDB *pDb, const char *ids, int **pList)
+{
+    const char *id = ids;
+    int *list;
+    int num = 0;
+    size_t maxIds = 1;
+
+    for (const char *p = ids; *p != '\0'; p++) {
+        if (*p == ',')
+            maxIds++;
+    }
 
-		if ((pRoute = malloc(sizeof (RouteInfo))) == NULL) {
-			fprintf(stderr, "ERROR: failed to alloc route record!\n");
-			return -1;
-		}
+    if ((list = malloc(maxIds * sizeof (int))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc route list!\n");
+        return -1;
+    }
 
-		*pRoute = info;
+    while (*id != '\0') {
+        size_t len = strcspn(id, ",");
+        int index;
 
-		// Add entry to the DB
-		TAILQ_INSERT_TAIL(&pDb->routeList, pRoute, tqEntry);
+        if ((len != 0) && ((index = rtDbIdLookup(pDb, id, len)) >= 0))
+            list[num++] = index;
 
-		pDb->numRoutes++;
-	}
+        id += len;
+        if (*id == ',')
+            id++;
+    }
 
-	return 0;
+    // Put the routes in their original order, dropping
+    // any repeated IDs.
+    qsort(list, num, sizeof (int), cmpInt);
+    if (num != 0) {
+        int n = 1;
+        for (int i = 1; i < num; i++) {
+            if (list[i] != list[n - 1])
+                list[n++] = list[i];
+        }
+        num = n;
+    }
+
+    *pList = list;
+
+    return num;
+}
+
+// Compare the routes of the DB against those of a previous
+// version of the library, matching them by their IDs, and
+// return the sorted list of the routes that are new, or whose
+// contents or update time have changed, in *pList, with their
+// change recorded in the route. Returns the number of routes,
+// or -1 on error.
+static int diffRouteDb(RouteDB *pDb, RouteDB *pPrevDb, int **pList)
+{
+    int *list;
+    int num = 0;
+
+    if (((pDb->hash == NULL) && (rtDbHashRoutes(pDb) != 0)) ||
+        ((pPrevDb->hash == NULL) && (rtDbHashRoutes(pPrevDb) != 0)) ||
+        ((pPrevDb->idHash.slots == NULL) && (rtDbBuildIdHash(pPrevDb) != 0))) {
+        // Error already printed
+        return -1;
+    }
+
+    if ((list = malloc((pDb->numRecs + 1) * sizeof (int))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc route list!\n");
+        return -1;
+    }
+
+    for (int n = 0; n < pDb->numRecs; n++) {
+        const JsonStrView *pId = &pDb->routes[n].id;
+        int prev = rtDbIdLookup(pPrevDb, pId->str, pId->len);
+
+        if (prev < 0) {
+            pDb->routes[n].delta = rdlAdded;
+            list[num++] = n;
+        } else if ((pPrevDb->hash[prev] != pDb->hash[n]) ||
+                   (pPrevDb->updated[prev] != pDb->updated[n])) {
+            pDb->routes[n].delta = rdlChanged;
+            list[num++] = n;
+        }
+    }
+
+    *pList = list;
+
+    return num;
+}
+
+// Select the routes of the previous version of the library
+// that are no longer in the DB, and that match the filters,
+// so they are listed in the output after the routes of the
+// DB, as removed routes.
+static int selectRemovedRoutes(RouteDB *pDb, RouteDB *pPrevDb, const CmdArgs *pArgs)
+{
+    FltPlan plan;
+    int *list = NULL;
+    uint8_t *match = NULL;
+    int num = 0;
+
+    if (((list = calloc((pPrevDb->numRecs + 1), sizeof (int))) == NULL) ||
+        ((match = malloc(pPrevDb->numRecs + 1)) == NULL)) {
+        fprintf(stderr, "ERROR: failed to alloc route list!\n");
+        free(list);
+        return -1;
+    }
+
+    for (int n = 0; n < pPrevDb->numRecs; n++) {
+        const JsonStrView *pId = &pPrevDb->routes[n].id;
+        if (rtDbIdLookup(pDb, pId->str, pId->len) < 0)
+            list[num++] = n;
+    }
+
+    fltCompile(&plan, pArgs, 0);
+    fltApply(pPrevDb, &plan, list, 0, num, match);
+
+    for (int n = 0; n < num; n++) {
+        pPrevDb->routes[list[n]].delta = rdlRemoved;
+    }
+    selectRoutes(pPrevDb, list, num, match);
+    pDb->removedDb = pPrevDb;
+
+    // The SHIZ URL prefix isn't part of the snapshot
+    pPrevDb->shizUrlPfx = pDb->shizUrlPfx;
+
+    free(match);
+    free(list);
+
+    return 0;
+}
+
+// Apply the match filters to all the routes in the DB. If the
+// DB has been indexed, the filters on the indexed fields are
+// resolved using the indexes, and the rest of the filters only
+// need to be applied to the routes they returned. If route IDs
+// are specified, only the routes with those IDs are checked;
+// and if a previous version of the DB is specified, only the
+// routes that are new or have changed since then.
+static int filterRouteDb(RouteDB *pDb, const CmdArgs *pArgs, RouteDB *pPrevDb)
+{
+    FltPlan plan;
+    int *cands = NULL;
+    int numCands = pDb->numRecs;
+    uint8_t *match;
+
+    if (((pArgs->ids != NULL) || (pPrevDb != NULL)) &&
+        (pDb->idHash.slots == NULL) && (rtDbBuildIdHash(pDb) != 0)) {
+        // Error already printed
+        return -1;
+    }
+
+    if ((pArgs->ids != NULL) && ((numCands = lookupIds(pDb, pArgs->ids, &cands)) < 0)) {
+        // Error already printed
+        return -1;
+    }
+
+    if (pPrevDb != NULL) {
+        int *list;
+        int num;
+
+        if (((num = diffRouteDb(pDb, pPrevDb, &list)) < 0) ||
+            (selectRemovedRoutes(pDb, pPrevDb, pArgs) != 0)) {
+            // Error already printed
+            free(cands);
+            return -1;
+        }
+
+        numCands = addCandidates(&cands, numCands, list, num);
+    }
+
+    if (pDb->indexed) {
+        int *list;
+        int num;
+
+        if ((num = lookupIndexes(pDb, pArgs, &list)) < 0) {
+            // Error already printed
+            free(cands);
+            return -1;
+        }
+
+        if (list != NULL)
+            numCands = addCandidates(&cands, numCands, list, num);
+    }
+
+    if ((match = malloc(numCands + 1)) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc match flags!\n");
+        free(cands);
+        return -1;
+    }
+
+    fltCompile(&plan, pArgs, pDb->indexed);
+    fltApply(pDb, &plan, cands, 0, numCands, match);
+    selectRoutes(pDb, cands, numCands, match);
+
+    if (pArgs->explain) {
+        if (cands != NULL)
+            fprintf(stderr, "Index lookup: %d of %d routes are candidates\n", numCands, pDb->numRecs);
+        fltExplain(&plan, stderr);
+    }
+
+    free(match);
+    free(cands);
+
+    return 0;
 }
 
 static void getShizFiles(const RouteDB *pDb, const CmdArgs *pArgs)
@@ -775,7 +1292,7 @@ static void getShizFiles(const RouteDB *pDb, const CmdArgs *pArgs)
 
     TAILQ_FOREACH(pRoute, &pDb->routeList, tqEntry) {
         char url[256];
-        snprintf(url, sizeof (url), "%s%s", pDb->shizUrlPfx, pRoute->shiz);
+        snprintf(url, sizeof (url), "%s" JSON_SV_FMT, pDb->shizUrlPfx, JSON_SV_ARG(pRoute->shiz));
         urlDownload(url, NULL, pArgs);
     }
 }
@@ -787,11 +1304,11 @@ static void getVideoFiles(const RouteDB *pDb, const CmdArgs *pArgs)
     TAILQ_FOREACH(pRoute, &pDb->routeList, tqEntry) {
         char url[256];
         if (pArgs->getVideo == res720p) {
-            snprintf(url, sizeof (url), "%s%s", pDb->mp4UrlPfx, pRoute->vim720);
+            snprintf(url, sizeof (url), "%s" JSON_SV_FMT, pDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim720));
         } else if (pArgs->getVideo == res1080p) {
-            snprintf(url, sizeof (url), "%s%s", pDb->mp4UrlPfx, pRoute->vim1080);
+            snprintf(url, sizeof (url), "%s" JSON_SV_FMT, pDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim1080));
         } else {
-            snprintf(url, sizeof (url), "%s%s", pDb->mp4UrlPfx, pRoute->vimMaster);
+            snprintf(url, sizeof (url), "%s" JSON_SV_FMT, pDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vimMaster));
         }
         urlDownload(url, NULL, pArgs);
     }
@@ -803,72 +1320,437 @@ static void expGpxFiles(const RouteDB *pDb, const CmdArgs *pArgs)
 
     TAILQ_FOREACH(pRoute, &pDb->routeList, tqEntry) {
         char filePath[256];
-        snprintf(filePath, sizeof (filePath), "%s/%s", pArgs->dlFolder, pRoute->shiz);
-        shizToGpx(pRoute->title, filePath);
+        char title[256];
+        snprintf(filePath, sizeof (filePath), "%s/" JSON_SV_FMT, pArgs->dlFolder, JSON_SV_ARG(pRoute->shiz));
+        shizToGpx(jsonStrViewCpy(&pRoute->title, title, sizeof (title)), filePath);
     }
 }
 
-static int procMainObj(const JsonObject *pObj, const CmdArgs *pArgs)
+// Build the route DB from the main JSON object of the
+// allrides file and, if requested, select the routes
+// that match the filters.
+static int procMainObj(const JsonObject *pObj, RouteDB *pDb, const CmdArgs *pArgs, int filter)
 {
-	RouteDB routeDb;
-	char *result;
+	JsonStrView result, prefix;
 	JsonObject data = {0};
 
-	rtDbInit(&routeDb);
-	routeDb.shizUrlPfx = "https://assets.fulgaz.com/";
-
-	if (jsonGetStringValue(pObj, "result", &result) != 0) {
+	if (jsonGetStringView(pObj, "result", &result) != 0) {
 		fprintf(stderr, "ERROR: failed to get \"result\" value!\n");
 		return -1;
 	}
 
-	if (jsonGetStringValue(pObj, "prefix", &routeDb.mp4UrlPfx) != 0) {
+	if (jsonGetStringView(pObj, "prefix", &prefix) != 0) {
 		fprintf(stderr, "ERROR: failed to get \"prefix\" value!\n");
 		return -1;
 	}
 
+	if ((pDb->mp4UrlPfx = rtDbStrDup(pDb, prefix.str, prefix.len)) == NULL) {
+	    // Error already printed
+	    return -1;
+	}
+
 	// Get the "data":[] array which contains all
 	// the route objects in the library.
 	if (jsonFindArrayByTag(pObj, "data", &data) == 0) {
 		// Process each route object in the "data" array ...
-	    CbInfo cbInfo = { .routeDb = &routeDb, .cmdArgs = pArgs };
-	    if (jsonArrayForEach(&data, procRouteObj, &cbInfo) != 0) {
+	    if (procRouteArray(&data, pDb, pArgs, filter) != 0) {
 	        // Error already printed
 	        return -1;
 	    }
+	} else if (rtDbAlloc(pDb, 0) != 0) {
+	    // Error already printed
+	    return -1;
+	}
+
+	//printf("numRoutes=%d\n", pDb->numRoutes);
+
+	return 0;
+}
+
+// Sort the selected routes of the DB, and/or keep only the
+// first 'limit' ones, as requested.
+static void sortRouteList(RouteDB *pDb, const CmdArgs *pArgs, int limit)
+{
+    if ((limit != 0) && (pArgs->numSortKeys != 0)) {
+        rtDbTopK(pDb, pArgs->sortKeys, pArgs->numSortKeys, limit);
+    } else if (pArgs->numSortKeys != 0) {
+        rtDbSort(pDb, pArgs->sortKeys, pArgs->numSortKeys);
+    } else if (limit != 0) {
+        rtDbTruncate(pDb, limit);
+    }
+}
+
+// Generate the output, and do the downloads and exports,
+// for the selected routes.
+static void procRouteDb(RouteDB *pDb, const CmdArgs *pArgs)
+{
+    // If requested, sort the routes and/or keep only the
+    // first ones.
+    sortRouteList(pDb, pArgs, pArgs->limit);
+
+    // The removed routes are listed after the others, so
+    // they only get the room the others left.
+    if (pDb->removedDb != NULL) {
+        if ((pArgs->limit != 0) && (pDb->numRoutes >= pArgs->limit))
+            rtDbDeselectAll(pDb->removedDb);
+        else
+            sortRouteList(pDb->removedDb, pArgs, (pArgs->limit != 0) ? (pArgs->limit - pDb->numRoutes) : 0);
+    }
+
+    // Create output file
+    if (pArgs->outFmt == csv) {
+        printCsvOutput(pDb, pArgs);
+    } else if (pArgs->outFmt == html) {
+        printHttpOutput(pDb, pArgs);
+    } else if (pArgs->outFmt == text) {
+        printTextOutput(pDb, pArgs);
+    } else if (pArgs->outFmt == json) {
+        printJsonOutput(pDb, pArgs);
+    }
+
+    // The dry-run total is that of this query alone, when
+    // running more than one (see --query-file).
+    totalContentLength = 0;
+
+    // If requested, download the SHIZ control files
+    if ((pArgs->getShiz || pArgs->expGpx) && !pArgs->noDownload) {
+        getShizFiles(pDb, pArgs);
+    }
+
+    // If requested, download the MP4 video files
+    if (pArgs->getVideo && !pArgs->noDownload) {
+        getVideoFiles(pDb, pArgs);
+    }
+
+    // If requested, export the GPX files
+    if (pArgs->expGpx) {
+        expGpxFiles(pDb, pArgs);
+    }
+
+    if (pArgs->dryRun) {
+        fprintf(pArgs->outFile, "TOTAL DOWNLOAD SIZE: %s\n", fmtContentLength(totalContentLength));
+    }
+}
+
+// Load the route DB: from the snapshot of the allrides file,
+// unless disabled or the file has changed since the snapshot
+// was saved, or else by parsing the file. If the file is
+// parsed, its contents are kept in the InFile, as the string
+// views of the routes refer to them; and, if requested, the
+// filters are applied to the routes as they are parsed.
+static int loadRouteDb(InFile *pInFile, RouteDB *pDb, const CmdArgs *pArgs, int filter)
+{
+    JsonTape tape = {0};
+    JsonObject mainObj = {0};
+    SnapSrc snapSrc = {0};
+    char snapPath[1100];
+    int fromSnap = 0;
+
+    // Unless disabled, try to load the route DB from the
+    // snapshot of the allrides file, which is valid if the
+    // file hasn't changed since the snapshot was saved.
+    if (!pArgs->noCache) {
+        snprintf(snapPath, sizeof (snapPath), "%s.snap", pInFile->filePath);
+        if ((snapGetSrcInfo(pInFile->filePath, &snapSrc) == 0) &&
+            (snapLoad(pDb, snapPath, &snapSrc) == 0)) {
+            fromSnap = 1;
+        }
+    }
 
-		//printf("numRoutes=%d\n", routeDb.numRoutes);
+    // Read in the entire file
+    if (!fromSnap) {
+        int fd;
+        struct stat stBuf = {0};
 
-		// Create output file
-		if (pArgs->outFmt == csv) {
-		    printCsvOutput(&routeDb, pArgs);
-        } else if (pArgs->outFmt == html) {
-            printHttpOutput(&routeDb, pArgs);
-        } else if (pArgs->outFmt == text) {
-            printTextOutput(&routeDb, pArgs);
+        if ((fd = open(pInFile->filePath, O_RDONLY, 0)) < 0) {
+            fprintf(stderr, "ERROR: can't open file \"%s\" (%s)\n", pInFile->filePath, strerror(errno));
+            return -1;
         }
 
-        // If requested, download the SHIZ control files
-        if (pArgs->getShiz || pArgs->expGpx) {
-            getShizFiles(&routeDb, pArgs);
+        if (fstat(fd, &stBuf) != 0) {
+            fprintf(stderr, "ERROR: can't get file size (%s)\n", strerror(errno));
+            close(fd);
+            return -1;
         }
 
-        // If requested, download the MP4 video files
-        if (pArgs->getVideo) {
-            getVideoFiles(&routeDb, pArgs);
+        pInFile->dataLen = stBuf.st_size;
+
+        if ((pInFile->data = malloc(pInFile->dataLen)) == NULL) {
+            fprintf(stderr, "ERROR: can't alloc data buffer (%s)\n", strerror(errno));
+            close(fd);
+            return -1;
         }
 
-        // If requested, export the GPX files
-        if (pArgs->expGpx) {
-            expGpxFiles(&routeDb, pArgs);
+        if (read(fd, pInFile->data, pInFile->dataLen) != pInFile->dataLen) {
+            fprintf(stderr, "ERROR: can't read data (%s)\n", strerror(errno));
+            close(fd);
+            goto error;
         }
 
-        if (pArgs->dryRun) {
-            printf("TOTAL DOWNLOAD SIZE: %s\n", fmtContentLength(totalContentLength));
+        close(fd);
+
+        // The file may have just been touched, e.g. by the
+        // app re-downloading the same library, in which case
+        // the snapshot is still good if the contents match.
+        if (!pArgs->noCache) {
+            snapSrc.hash = snapHash(pInFile->data, pInFile->dataLen);
+            snapSrc.hashValid = 1;
+            if (snapLoad(pDb, snapPath, &snapSrc) == 0) {
+                fromSnap = 1;
+                free(pInFile->data);
+                pInFile->data = NULL;
+            }
         }
-	}
+    }
 
-	return 0;
+    if (!fromSnap) {
+        // Tokenize the file into a tape, so that the lookups
+        // of the route fields don't need to rescan the text of
+        // each route object over and over again.
+        if ((jsonTapeBuild(pInFile->data, pInFile->dataLen, &tape) != 0) ||
+            (jsonTapeGetRoot(&tape, &mainObj) != 0)) {
+            // Fall back to scanning the text: locate the
+            // main JSON object.
+            if (jsonFindObject(pInFile->data, pInFile->dataLen, &mainObj) != 0) {
+                fprintf(stderr, "ERROR: can't find main JSON object!\n");
+                goto error;
+            }
+        }
+
+        //jsonDumpObject(&mainObj);
+
+        // Process the main JSON object
+        if (procMainObj(&mainObj, pDb, pArgs, filter) != 0) {
+            // Error already printed
+            goto error;
+        }
+
+        jsonTapeFree(&tape);
+
+        // Index the routes, and save the snapshot for the
+        // next run.
+        if (!pArgs->noCache) {
+            if (rtDbBuildIndexes(pDb) == 0) {
+                snapSave(pDb, snapPath, &snapSrc);
+            }
+        }
+    }
+
+    pDb->shizUrlPfx = "https://assets.fulgaz.com/";
+
+    return 0;
+
+error:
+    jsonTapeFree(&tape);
+    rtDbFree(pDb);
+    free(pInFile->data);
+    pInFile->data = NULL;
+    return -1;
+}
+
+// Max number of words in a query
+#define MAX_QUERY_ARGS  64
+
+// Parse a query, i.e. a line with the same options as the
+// command line. The line is split into words at the blanks,
+// except within double quotes, and the options are parsed
+// just like the command-line ones; except the options in the
+// 'denyOpts' list, which are rejected. The values of the
+// options point into the line. The error messages go to the
+// specified file.
+static int parseQuery(char *query, const char **denyOpts, int numDenyOpts, CmdArgs *pArgs, FILE *errFp)
+{
+    char *argv[MAX_QUERY_ARGS + 1];
+    int argc = 0;
+    char *p = query;
+
+    argv[argc++] = "whatsOnFulGaz";
+    while (1) {
+        p += strspn(p, " \t");
+        if (*p == '\0')
+            break;
+        if (argc == MAX_QUERY_ARGS) {
+            fprintf(errFp, "ERROR: too many options!\n");
+            return -1;
+        }
+        if (*p == '"') {
+            argv[argc++] = ++p;
+            p += strcspn(p, "\"");
+        } else {
+            argv[argc++] = p;
+            p += strcspn(p, " \t");
+        }
+        if (*p != '\0')
+            *p++ = '\0';
+    }
+    argv[argc] = NULL;
+
+    for (int n = 1; n < argc; n++) {
+        for (int i = 0; i < numDenyOpts; i++) {
+            if (strcmp(argv[n], denyOpts[i]) == 0) {
+                fprintf(errFp, "ERROR: option not supported in queries: %s\n", argv[n]);
+                return -1;
+            }
+        }
+    }
+
+    memset(pArgs, 0, sizeof (*pArgs));
+    if (parseCmdArgs(argc, argv, pArgs, errFp) != 0) {
+        fprintf(errFp, "ERROR: invalid query!\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Options that don't apply to the queries of the query file
+static const char *batchDenyOpts[] = {
+    "--allrides-file",
+    "--help",
+    "--no-cache",
+    "--query-file",
+    "--save-snapshot",
+    "--serve",
+    "--since",
+    "--version",
+};
+
+// Run the queries of the query file against the route DB,
+// which is only loaded once. Each line of the file is a query
+// with its own filter, sort, format and download options, and
+// its output goes to the file specified by its "--output-file"
+// option, or else to stdout. Blank lines and lines starting
+// with '#' are ignored. A query that fails doesn't stop the
+// rest of them.
+static int runQueryFile(RouteDB *pDb, const char *queryFile)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t lineSize = 0;
+    int lineNum = 0;
+    int s = 0;
+
+    if ((fp = fopen(queryFile, "r")) == NULL) {
+        fprintf(stderr, "ERROR: can't open query file \"%s\" (%s)\n", queryFile, strerror(errno));
+        return -1;
+    }
+
+    while (getline(&line, &lineSize, fp) >= 0) {
+        char *query = line + strspn(line, " \t");
+        CmdArgs cmdArgs;
+
+        lineNum++;
+        query[strcspn(query, "\r\n")] = '\0';
+        if ((*query == '\0') || (*query == '#'))
+            continue;
+
+        if (parseQuery(query, batchDenyOpts, (sizeof (batchDenyOpts) / sizeof (batchDenyOpts[0])), &cmdArgs, stderr) != 0) {
+            fprintf(stderr, "ERROR: invalid query at line %d of \"%s\"\n", lineNum, queryFile);
+            s = -1;
+            continue;
+        }
+
+        if ((cmdArgs.outPath != NULL) && ((cmdArgs.outFile = fopen(cmdArgs.outPath, "w")) == NULL)) {
+            fprintf(stderr, "ERROR: can't create output file \"%s\" (%s)\n", cmdArgs.outPath, strerror(errno));
+            s = -1;
+            continue;
+        }
+
+        rtDbDeselectAll(pDb);
+        if (filterRouteDb(pDb, &cmdArgs, NULL) == 0) {
+            procRouteDb(pDb, &cmdArgs);
+        } else {
+            s = -1;
+        }
+
+        if ((cmdArgs.outFile != stdout) && (fclose(cmdArgs.outFile) != 0)) {
+            fprintf(stderr, "ERROR: can't write output file \"%s\" (%s)\n", cmdArgs.outPath, strerror(errno));
+            s = -1;
+        }
+    }
+
+    free(line);
+    fclose(fp);
+
+    return s;
+}
+
+// State of the query daemon
+typedef struct SrvInfo {
+    InFile inFile;
+    RouteDB routeDb;
+    const CmdArgs *cmdArgs;     // options of the daemon
+} SrvInfo;
+
+// Options that don't apply to the queries of the daemon
+static const char *srvDenyOpts[] = {
+    "--allrides-file",
+    "--download-folder",
+    "--download-progress",
+    "--dry-run",
+    "--explain",
+    "--export-gpx",
+    "--get-shiz",
+    "--get-video",
+    "--help",
+    "--no-cache",
+    "--no-download",
+    "--output-file",
+    "--query-file",
+    "--save-snapshot",
+    "--serve",
+    "--since",
+    "--version",
+};
+
+// Answer a query of the daemon
+static int serveReq(char *req, FILE *fp, void *arg)
+{
+    SrvInfo *pSrv = arg;
+    CmdArgs cmdArgs;
+
+    if (parseQuery(req, srvDenyOpts, (sizeof (srvDenyOpts) / sizeof (srvDenyOpts[0])), &cmdArgs, fp) != 0) {
+        // Error already printed
+        return -1;
+    }
+    cmdArgs.outFile = fp;
+
+    rtDbDeselectAll(&pSrv->routeDb);
+    if (filterRouteDb(&pSrv->routeDb, &cmdArgs, NULL) != 0) {
+        fprintf(fp, "ERROR: query failed!\n");
+        return -1;
+    }
+
+    procRouteDb(&pSrv->routeDb, &cmdArgs);
+
+    return 0;
+}
+
+// Reload the route DB of the daemon after the allrides file
+// has changed. The current DB stays in use if the new one
+// can't be loaded.
+static int serveReload(void *arg)
+{
+    SrvInfo *pSrv = arg;
+    InFile inFile = { .filePath = pSrv->inFile.filePath };
+    RouteDB routeDb;
+
+    rtDbInit(&routeDb);
+
+    if ((loadRouteDb(&inFile, &routeDb, pSrv->cmdArgs, 0) != 0) ||
+        (!routeDb.indexed && (rtDbBuildIndexes(&routeDb) != 0))) {
+        rtDbFree(&routeDb);
+        free(inFile.data);
+        return -1;
+    }
+
+    rtDbFree(&pSrv->routeDb);
+    free(pSrv->inFile.data);
+    pSrv->inFile = inFile;
+    pSrv->routeDb = routeDb;
+    TAILQ_INIT(&pSrv->routeDb.routeList);
+
+    return 0;
 }
 
 int main(int argc, char *argv[])
@@ -876,15 +1758,14 @@ int main(int argc, char *argv[])
     CmdArgs cmdArgs = {0};
     OsTyp osTyp = unk;
     AllRidesFile allRides = {0};
-	struct InFile {
-        const char *filePath;
-        char *data;
-        size_t dataLen;
-	} inFile = {0};
-    JsonObject mainObj = {0};
+    InFile inFile = {0};
+    RouteDB routeDb;
+    RouteDB prevDb;
+    SnapSrc snapSrc = {0};
+    int fused;
 
     // Parse the command-line arguments
-    if (parseCmdArgs(argc, argv, &cmdArgs) != 0) {
+    if (parseCmdArgs(argc, argv, &cmdArgs, stderr) != 0) {
         fprintf(stderr, "Use --help for the list of supported options.\n\n");
         return -1;
     }
@@ -921,54 +1802,110 @@ int main(int argc, char *argv[])
 
     //printf("Found rides file: %s\n", filePath);
 
-    // Read in the entire file
-    {
-        int fd;
-        struct stat stBuf = {0};
+    rtDbInit(&routeDb);
+    rtDbInit(&prevDb);
 
-        if ((fd = open(inFile.filePath, O_RDONLY, 0)) < 0) {
-            fprintf(stderr, "ERROR: can't open file \"%s\" (%s)\n", inFile.filePath, strerror(errno));
-            return -1;
-        }
+    // Without a snapshot the indexes wouldn't pay off, so
+    // the filters are applied to the routes as they are
+    // parsed; unless the routes are selected by their IDs,
+    // or by the changes since a previous snapshot, as then
+    // only those routes need to be checked, or the DB is
+    // used for more than one query.
+    fused = cmdArgs.noCache && (cmdArgs.ids == NULL) && (cmdArgs.since == NULL) &&
+            (cmdArgs.saveSnap == NULL) && (cmdArgs.serveSock == NULL) && (cmdArgs.queryFile == NULL);
 
-        if (fstat(fd, &stBuf) != 0) {
-            fprintf(stderr, "ERROR: can't get file size (%s)\n", strerror(errno));
+    if (loadRouteDb(&inFile, &routeDb, &cmdArgs, fused) != 0) {
+        // Error already printed
+        return -1;
+    }
+
+    // If requested, save a copy of the snapshot, e.g. to
+    // compare the next version of the library against it.
+    if (cmdArgs.saveSnap != NULL) {
+        if ((!routeDb.indexed && (rtDbBuildIndexes(&routeDb) != 0)) ||
+            (snapGetSrcInfo(inFile.filePath, &snapSrc) != 0) ||
+            (snapSave(&routeDb, cmdArgs.saveSnap, &snapSrc) != 0)) {
+            fprintf(stderr, "ERROR: can't save snapshot file \"%s\"\n", cmdArgs.saveSnap);
             return -1;
         }
+    }
 
-        inFile.dataLen = stBuf.st_size;
+    // If requested, keep the route DB around, and answer
+    // the queries that arrive on the socket.
+    if (cmdArgs.serveSock != NULL) {
+        SrvInfo srvInfo = { .inFile = inFile, .routeDb = routeDb, .cmdArgs = &cmdArgs };
 
-        if ((inFile.data = malloc(inFile.dataLen)) == NULL) {
-            fprintf(stderr, "ERROR: can't alloc data buffer (%s)\n", strerror(errno));
+        TAILQ_INIT(&srvInfo.routeDb.routeList);
+        if (!srvInfo.routeDb.indexed && (rtDbBuildIndexes(&srvInfo.routeDb) != 0)) {
+            // Error already printed
             return -1;
         }
 
-        if (read(fd, inFile.data, inFile.dataLen) != inFile.dataLen) {
-            fprintf(stderr, "ERROR: can't read data (%s)\n", strerror(errno));
+        if (srvRun(cmdArgs.serveSock, inFile.filePath, serveReq, serveReload, &srvInfo) != 0) {
+            // Error already printed
             return -1;
         }
 
-        close(fd);
-    }
-
-    // Locate the main JSON object
-	if (jsonFindObject(inFile.data, inFile.dataLen, &mainObj) != 0) {
-		fprintf(stderr, "ERROR: can't find main JSON object!\n");
-		return -1;
-	}
+        rtDbFree(&srvInfo.routeDb);
+        free(srvInfo.inFile.data);
 
-	//jsonDumpObject(&mainObj);
+        return 0;
+    }
 
 	if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
         fprintf(stderr, "ERROR: can't init CURL library!\n");
         return -1;
 	}
 
-	// Process the main JSON object
-	procMainObj(&mainObj, &cmdArgs);
+    // If requested, run the queries of the query file
+    // against the DB, instead of the command-line ones.
+    if (cmdArgs.queryFile != NULL) {
+        int s;
+
+        if (!routeDb.indexed && (rtDbBuildIndexes(&routeDb) != 0)) {
+            // Error already printed
+            return -1;
+        }
+
+        s = runQueryFile(&routeDb, cmdArgs.queryFile);
+
+        curl_global_cleanup();
+        rtDbFree(&routeDb);
+        free(inFile.data);
+
+        return s;
+    }
+
+    if (!fused) {
+        // If requested, load the previous snapshot to
+        // compare the routes against.
+        if ((cmdArgs.since != NULL) && (snapLoad(&prevDb, cmdArgs.since, NULL) != 0)) {
+            fprintf(stderr, "ERROR: can't load snapshot file \"%s\"\n", cmdArgs.since);
+            return -1;
+        }
+
+        if (filterRouteDb(&routeDb, &cmdArgs, (cmdArgs.since != NULL) ? &prevDb : NULL) != 0) {
+            // Error already printed
+            return -1;
+        }
+    }
+
+    if ((cmdArgs.outPath != NULL) && ((cmdArgs.outFile = fopen(cmdArgs.outPath, "w")) == NULL)) {
+        fprintf(stderr, "ERROR: can't create output file \"%s\" (%s)\n", cmdArgs.outPath, strerror(errno));
+        return -1;
+    }
+
+	procRouteDb(&routeDb, &cmdArgs);
 
 	curl_global_cleanup();
 
+    if ((cmdArgs.outFile != stdout) && (fclose(cmdArgs.outFile) != 0)) {
+        fprintf(stderr, "ERROR: can't write output file \"%s\" (%s)\n", cmdArgs.outPath, strerror(errno));
+        return -1;
+    }
+
+    rtDbFree(&routeDb);
+    rtDbFree(&prevDb);
     free(inFile.data);
 
     return 0;
@@ -4,16 +4,17 @@
 #include <string.h>
 
 #include "args.h"
+#include "output.h"
 #include "routedb.h"
 
 // A few routes include a comma in their description which
 // screws up the CSV output format...
-static char *fmtTitle(const char *title)
+char *fmtTitle(const JsonStrView *title)
 {
     char *p;
     static char fmtBuf[128];
 
-    snprintf(fmtBuf, sizeof (fmtBuf), "%s", title);
+    jsonStrViewCpy(title, fmtBuf, sizeof (fmtBuf));
     if ((p = strchr(fmtBuf, ',')) != NULL) {
         *p = '\0';
     }
@@ -21,90 +22,79 @@ static char *fmtTitle(const char *title)
     return fmtBuf;
 }
 
-// Extract the country from the location string, which looks
-// like this:
+// The location string looks like this:
 //   "Barossa Valley, South Australia, Australia"
-//
-static char *fmtCountry(const char *location)
-{
-    char *p;
-    static char fmtBuf[128];
+// The country and the province/state are extracted from it
+// as spans of the raw JSON text, which never split an escape
+// sequence, since they are delimited by commas and white
+// space; or "???" if they are empty.
+static const JsonStrView locUnknown = { "???", 3 };
 
-    fmtBuf[0] = '\0';
+static int locIsSpace(char c)
+{
+    return isspace((unsigned char) c);
+}
 
-    // Locate the last comma character, before
-    // the country name...
-    if ((p = strrchr(location, ',')) != NULL) {
-        // Remove any white space after the comma
-        for (p = p+1; *p != '\0'; p++) {
-            int c = *p;
-            if (!isspace(c))
-                break;
+// The country is after the last comma, or the whole string
+// if there is no comma.
+static JsonStrView locCountry(const JsonStrView *locView)
+{
+    JsonStrView span = *locView;
+
+    for (size_t n = locView->len; n > 0; n--) {
+        if (locView->str[n - 1] == ',') {
+            // Remove any white space after the comma
+            while ((n < locView->len) && locIsSpace(locView->str[n]))
+                n++;
+            span.str = locView->str + n;
+            span.len = locView->len - n;
+            break;
         }
-        snprintf(fmtBuf, sizeof (fmtBuf), "%s", p);
-    } else if (location[0] != '\0') {
-        snprintf(fmtBuf, sizeof (fmtBuf), "%s", location);
-    }
-
-    if (fmtBuf[0] == '\0') {
-        snprintf(fmtBuf, sizeof (fmtBuf), "???");
     }
 
-    return fmtBuf;
+    return (span.len != 0) ? span : locUnknown;
 }
 
-// Extract the province/state from the location string, which
-// looks like this:
-//   "Boulder, Colorado, USA"
-//
-static char *fmtProvince(const char *location)
+// The province/state is before the last comma, and after the
+// previous one, if any: a few routes do not have a city before
+// the province or state, so there is no such comma.
+static JsonStrView locProvince(const JsonStrView *locView)
 {
-    char *p0, *p1;
-    static char fmtBuf[128];
+    const char *str = locView->str;
+    size_t start = 0, end = locView->len;
 
-    fmtBuf[0] = '\0';
+    while ((end > 0) && (str[end - 1] != ','))
+        end--;
+    if (end == 0)
+        return locUnknown;
 
-    // Locate the last comma character, before
-    // the country name...
-    if ((p1 = strrchr(location, ',')) != NULL) {
-        // Remove any white space before the comma
-        for (p1 = p1-1; p1 != location; p1--) {
-            int c = *p1;
-            if (!isspace(c))
-                break;
-        }
+    // Remove any white space before the comma
+    for (end--; (end > 0) && locIsSpace(str[end - 1]); end--)
+        ;
 
-        // Locate the previous comma character, before
-        // the province/state name. Notice that a few
-        // routes do not have a city before the province
-        // or state, so there is no such comma character.
-        for (p0 = p1; p0 != location; p0--) {
-            int c = *p0;
-            if (c == ',') {
-                // Remove any white space after the comma
-                for (p0 = p0+1; *p0 != '\0'; p0++) {
-                    int c = *p0;
-                    if (!isspace(c))
-                        break;
-                }
-                break;
-            }
-        }
-        {
-            char *p;
+    for (start = end; (start > 0) && (str[start - 1] != ','); start--)
+        ;
+    // Remove any white space after the comma
+    while ((start < end) && locIsSpace(str[start]))
+        start++;
 
-            for (p = fmtBuf; p0 <= p1; p0++) {
-                *p++ = *p0;
-            }
-            *p = '\0';
-        }
-    }
+    return (start < end) ? (JsonStrView) { (str + start), (end - start) } : locUnknown;
+}
 
-    if (fmtBuf[0] == '\0') {
-        snprintf(fmtBuf, sizeof (fmtBuf), "???");
-    }
+char *fmtCountry(const JsonStrView *locView)
+{
+    static char fmtBuf[128];
+    JsonStrView span = locCountry(locView);
 
-    return fmtBuf;
+    return jsonStrViewCpy(&span, fmtBuf, sizeof (fmtBuf));
+}
+
+char *fmtProvince(const JsonStrView *locView)
+{
+    static char fmtBuf[128];
+    JsonStrView span = locProvince(locView);
+
+    return jsonStrViewCpy(&span, fmtBuf, sizeof (fmtBuf));
 }
 
 static void remChar(char *n, char *s, char c)
@@ -132,11 +122,11 @@ static void repChar(char *n, char *s, char c, char nc)
 }
 
 // Format categories as Hilly/Long/New/etc
-static char *fmtCategories(const char *categories)
+char *fmtCategories(const JsonStrView *categories)
 {
     static char fmtBuf[128];
 
-    snprintf(fmtBuf, sizeof (fmtBuf), "%s", categories);
+    jsonStrViewCpy(categories, fmtBuf, sizeof (fmtBuf));
     remChar(fmtBuf, fmtBuf, '[');
     remChar(fmtBuf, fmtBuf, ']');
     remChar(fmtBuf, fmtBuf, '"');
@@ -145,37 +135,73 @@ static char *fmtCategories(const char *categories)
 }
 
 // Format distance
-static char *fmtDistance(const char *distance, Units units)
+char *fmtDistance(float distance, Units units)
 {
     static char fmtBuf[32];
-    float val = atof(distance);
 
     if (units == metric) {
-        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", val);
+        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", distance);
     } else {
-        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", (val / 1.60934));
+        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", (distance / 1.60934));
     }
 
     return fmtBuf;
 }
 
 // Format elevation gain
-static char *fmtElevGain(const char *elevGain, Units units)
+char *fmtElevGain(float elevGain, Units units)
 {
     static char fmtBuf[32];
-    float val = atof(elevGain);
 
     if (units == metric) {
-        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", val);
+        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", elevGain);
     } else {
-        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", (val * 3.28083));
+        snprintf(fmtBuf, sizeof (fmtBuf), "%.3f", (elevGain * 3.28083));
+    }
+
+    return fmtBuf;
+}
+
+static void strShiftLeft(char *str, size_t count)
+{
+    size_t len = strlen(str) + 1;
+    memmove(str, (str+count), (len - count));
+}
+
+// Format the description, removing the escape characters
+// of the embedded double quotes, and the embedded newlines.
+char *fmtDescription(const JsonStrView *description)
+{
+    static char *fmtBuf = NULL;
+    static size_t fmtBufLen = 0;
+    char *p;
+
+    if (fmtBufLen <= description->len) {
+        free(fmtBuf);
+        fmtBufLen = description->len + 1;
+        if ((fmtBuf = malloc(fmtBufLen)) == NULL) {
+            fmtBufLen = 0;
+            return "";
+        }
+    }
+
+    jsonStrViewCpy(description, fmtBuf, fmtBufLen);
+
+    p = fmtBuf;
+    while ((p = strstr(p, "\\\"")) != NULL) {
+        strShiftLeft(p, 1);
+    }
+
+    p = fmtBuf;
+    while ((p = strstr(p, "\\n")) != NULL) {
+        strShiftLeft(p, 2);
     }
 
     return fmtBuf;
 }
 
 // Format time as HH:MM:SS
-static char *fmtTime(int time)
+char *fmtTime(int time)
 {
     static char fmtBuf[128];
     int hr, min, sec;
@@ -203,6 +229,7 @@ typedef enum CellName {
     video1080p,
     video4K,
     shiz,
+    status,
 } CellName;
 
 static const char *cellName[] = {
@@ -220,13 +247,29 @@ static const char *cellName[] = {
         [video1080p] = "1080p Video",
         [video4K] = "4K Video",
         [shiz] = "SHIZ",
+        [status] = "Status",
 };
 
+static const char *deltaName[] = {
+        [rdlNone] = "",
+        [rdlAdded] = "added",
+        [rdlChanged] = "changed",
+        [rdlRemoved] = "removed",
+};
+
+// Last column of the output: the status of each route is
+// only included when the routes are compared against those
+// of a previous version of the library.
+static CellName lastCell(const CmdArgs *pArgs)
+{
+    return (pArgs->since != NULL) ? status : shiz;
+}
+
 void printCsvOutput(const RouteDB *pDb, const CmdArgs *pArgs)
 {
     RouteInfo *pRoute;
 
-    for (CellName n = name; n <= shiz ; n++) {
+    for (CellName n = name; n <= lastCell(pArgs); n++) {
         // The description text can be quite long and
         // include commas, which is no-bueno in a CVS
         // file, so we skip it...
@@ -234,67 +277,80 @@ void printCsvOutput(const RouteDB *pDb, const CmdArgs *pArgs)
             continue;
 
         if (n == distance) {
-            printf("%s [%s],", cellName[n], (pArgs->units == metric) ? "km" : "mi");
+            fprintf(pArgs->outFile, "%s [%s],", cellName[n], (pArgs->units == metric) ? "km" : "mi");
         } else if (n == elevationGain) {
-            printf("%s [%s],", cellName[n], (pArgs->units == metric) ? "m" : "ft");
+            fprintf(pArgs->outFile, "%s [%s],", cellName[n], (pArgs->units == metric) ? "m" : "ft");
         } else {
-            printf("%s,", cellName[n]);
+            fprintf(pArgs->outFile, "%s,", cellName[n]);
         }
     }
-    printf("\n");
-
-    TAILQ_FOREACH(pRoute, &pDb->routeList, tqEntry) {
-        printf("%s,", fmtTitle(pRoute->title));
-        printf("%s,", fmtCountry(pRoute->location));
-        printf("%s,", fmtProvince(pRoute->location));
-        printf("%s,", pRoute->contributor);
-        printf("%s,", fmtCategories(pRoute->categories));
-        printf("%s,", fmtDistance(pRoute->distance, pArgs->units));
-        printf("%s,", fmtElevGain(pRoute->elevation, pArgs->units));
-        printf("%s,", fmtTime(pRoute->time));
-        printf("%s,", pRoute->toughness);
-        printf("%s%s,", pDb->mp4UrlPfx, pRoute->vim720);
-        printf("%s%s,", pDb->mp4UrlPfx, pRoute->vim1080);
-        printf("%s%s,", pDb->mp4UrlPfx, pRoute->vimMaster);
-        printf("%s%s,", pDb->shizUrlPfx, pRoute->shiz);
-        printf("\n");
+    fprintf(pArgs->outFile, "\n");
+
+    // The removed routes come from the previous version
+    // of the DB, along with their columns.
+    for (const RouteDB *pRtDb = pDb; pRtDb != NULL; pRtDb = pRtDb->removedDb) {
+        TAILQ_FOREACH(pRoute, &pRtDb->routeList, tqEntry) {
+            fprintf(pArgs->outFile, "%s,", fmtTitle(&pRoute->title));
+            fprintf(pArgs->outFile, "%s,", fmtCountry(&pRoute->location));
+            fprintf(pArgs->outFile, "%s,", fmtProvince(&pRoute->location));
+            fprintf(pArgs->outFile, JSON_SV_FMT ",", JSON_SV_ARG(pRoute->contributor));
+            fprintf(pArgs->outFile, "%s,", fmtCategories(&pRoute->categories));
+            fprintf(pArgs->outFile, "%s,", fmtDistance(pRtDb->distance[pRoute->index], pArgs->units));
+            fprintf(pArgs->outFile, "%s,", fmtElevGain(pRtDb->elevation[pRoute->index], pArgs->units));
+            fprintf(pArgs->outFile, "%s,", fmtTime(pRtDb->duration[pRoute->index]));
+            fprintf(pArgs->outFile, JSON_SV_FMT ",", JSON_SV_ARG(pRoute->toughness));
+            fprintf(pArgs->outFile, "%s" JSON_SV_FMT ",", pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim720));
+            fprintf(pArgs->outFile, "%s" JSON_SV_FMT ",", pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim1080));
+            fprintf(pArgs->outFile, "%s" JSON_SV_FMT ",", pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vimMaster));
+            fprintf(pArgs->outFile, "%s" JSON_SV_FMT ",", pRtDb->shizUrlPfx, JSON_SV_ARG(pRoute->shiz));
+            if (pArgs->since != NULL)
+                fprintf(pArgs->outFile, "%s,", deltaName[pRoute->delta]);
+            fprintf(pArgs->outFile, "\n");
+        }
     }
 }
 
-static void printStringCellValue(const char *string, int boldFace)
+static void printViewCellValue(FILE *fp, const JsonStrView *pView, int boldFace)
 {
-    printf("                <td width=\"10%%\" style=\"border-top: 1px solid #000000; border-bottom: 1px solid #000000; border-left: 1px solid #000000; border-right: none; padding-top: 0.04in; padding-bottom: 0.04in; padding-left: 0.04in; padding-right: 0in\">\n");
+    fprintf(fp, "                <td width=\"10%%\" style=\"border-top: 1px solid #000000; border-bottom: 1px solid #000000; border-left: 1px solid #000000; border-right: none; padding-top: 0.04in; padding-bottom: 0.04in; padding-left: 0.04in; padding-right: 0in\">\n");
     if (boldFace) {
-        printf("                    <p><font face=\"Tahoma, sans-serif\"><b>%s</b></font></p>\n", string);
+        fprintf(fp, "                    <p><font face=\"Tahoma, sans-serif\"><b>" JSON_SV_FMT "</b></font></p>\n", JSON_SV_ARG(*pView));
     } else {
-        printf("                    <p><font face=\"Tahoma, sans-serif\">%s</font></p>\n", string);
+        fprintf(fp, "                    <p><font face=\"Tahoma, sans-serif\">" JSON_SV_FMT "</font></p>\n", JSON_SV_ARG(*pView));
     }
-    printf("                </td>\n");
+    fprintf(fp, "                </td>\n");
+}
+
+static void printStringCellValue(FILE *fp, const char *string, int boldFace)
+{
+    JsonStrView view = { string, strlen(string) };
+
+    printViewCellValue(fp, &view, boldFace);
 }
 
-static void printHyperlinkCellValue(const char *string)
+static void printHyperlinkCellValue(FILE *fp, const char *string)
 {
-    printf("                <td width=\"10%%\" style=\"border-top: 1px solid #000000; border-bottom: 1px solid #000000; border-left: 1px solid #000000; border-right: none; padding-top: 0.04in; padding-bottom: 0.04in; padding-left: 0.04in; padding-right: 0in\">\n");
-    printf("                    <p><a href=\"%s\"><font face=\"Tahoma, sans-serif\">link</font></a></p>\n", string);
-    printf("                </td>\n");
+    fprintf(fp, "                <td width=\"10%%\" style=\"border-top: 1px solid #000000; border-bottom: 1px solid #000000; border-left: 1px solid #000000; border-right: none; padding-top: 0.04in; padding-bottom: 0.04in; padding-left: 0.04in; padding-right: 0in\">\n");
+    fprintf(fp, "                    <p><a href=\"%s\"><font face=\"Tahoma, sans-serif\">link</font></a></p>\n", string);
+    fprintf(fp, "                </td>\n");
 }
 
 void printHttpOutput(const RouteDB *pDb, const CmdArgs *pArgs)
 {
     RouteInfo *pRoute;
 
-    printf("<html>\n");
-    printf("    <head>\n");
-    printf("        <meta http-equiv=\"content-type\" content=\"text/html; charset=utf-8\"/>\n");
-    printf("        <title>FulGaz Route Library</title>\n");
-    printf("    </head>\n");
-    printf("    <body lang=\"en-US\" link=\"#000080\" vlink=\"#800000\" dir=\"ltr\">\n");
-    printf("        <table width=\"100%%\" cellpadding=\"4\" cellspacing=\"0\">\n");
-    for (CellName n = name; n <= shiz ; n++) {
-        printf("            <col width=\"26*\"/>\n");
+    fprintf(pArgs->outFile, "<html>\n");
+    fprintf(pArgs->outFile, "    <head>\n");
+    fprintf(pArgs->outFile, "        <meta http-equiv=\"content-type\" content=\"text/html; charset=utf-8\"/>\n");
+    fprintf(pArgs->outFile, "        <title>FulGaz Route Library</title>\n");
+    fprintf(pArgs->outFile, "    </head>\n");
+    fprintf(pArgs->outFile, "    <body lang=\"en-US\" link=\"#000080\" vlink=\"#800000\" dir=\"ltr\">\n");
+    fprintf(pArgs->outFile, "        <table width=\"100%%\" cellpadding=\"4\" cellspacing=\"0\">\n");
+    for (CellName n = name; n <= lastCell(pArgs); n++) {
+        fprintf(pArgs->outFile, "            <col width=\"26*\"/>\n");
     }
-    printf("            <tr valign=\"top\">\n");
-    for (CellName n = name; n <= shiz ; n++) {
+    fprintf(pArgs->outFile, "            <tr valign=\"top\">\n");
+    for (CellName n = name; n <= lastCell(pArgs); n++) {
         char label[64];
         if (n == distance) {
             snprintf(label, sizeof (label), "%s [%s]", cellName[n], (pArgs->units == metric) ? "km" : "mi");
@@ -303,64 +359,116 @@ void printHttpOutput(const RouteDB *pDb, const CmdArgs *pArgs)
         } else {
             snprintf(label, sizeof (label), "%s", cellName[n]);
         }
-        printStringCellValue(label, 1);
+        printStringCellValue(pArgs->outFile, label, 1);
     }
-    printf("            </tr>\n");
-    TAILQ_FOREACH(pRoute, &pDb->routeList, tqEntry) {
-        char link[256];
-        printf("            <tr valign=\"top\">\n");
-        printStringCellValue(fmtTitle(pRoute->title), 0);
-        printStringCellValue(fmtCountry(pRoute->location), 0);
-        printStringCellValue(fmtProvince(pRoute->location), 0);
-        printStringCellValue(pRoute->contributor, 0);
-        printStringCellValue(fmtCategories(pRoute->categories), 0);
-        printStringCellValue(pRoute->description, 0);
-        printStringCellValue(fmtDistance(pRoute->distance, pArgs->units), 0);
-        printStringCellValue(fmtElevGain(pRoute->elevation, pArgs->units), 0);
-        printStringCellValue(fmtTime(pRoute->time), 0);
-        printStringCellValue(pRoute->toughness, 0);
-        snprintf(link, sizeof (link), "%s%s", pDb->mp4UrlPfx, pRoute->vim720);
-        printHyperlinkCellValue(link);
-        snprintf(link, sizeof (link), "%s%s", pDb->mp4UrlPfx, pRoute->vim1080);
-        printHyperlinkCellValue(link);
-        snprintf(link, sizeof (link), "%s%s", pDb->mp4UrlPfx, pRoute->vimMaster);
-        printHyperlinkCellValue(link);
-        snprintf(link, sizeof (link), "%s%s", pDb->shizUrlPfx, pRoute->shiz);
-        printHyperlinkCellValue(link);
-        printf("            </tr>\n");
+    fprintf(pArgs->outFile, "            </tr>\n");
+    for (const RouteDB *pRtDb = pDb; pRtDb != NULL; pRtDb = pRtDb->removedDb) {
+        TAILQ_FOREACH(pRoute, &pRtDb->routeList, tqEntry) {
+            char link[256];
+            fprintf(pArgs->outFile, "            <tr valign=\"top\">\n");
+            printStringCellValue(pArgs->outFile, fmtTitle(&pRoute->title), 0);
+            printStringCellValue(pArgs->outFile, fmtCountry(&pRoute->location), 0);
+            printStringCellValue(pArgs->outFile, fmtProvince(&pRoute->location), 0);
+            printViewCellValue(pArgs->outFile, &pRoute->contributor, 0);
+            printStringCellValue(pArgs->outFile, fmtCategories(&pRoute->categories), 0);
+            printStringCellValue(pArgs->outFile, fmtDescription(&pRoute->description), 0);
+            printStringCellValue(pArgs->outFile, fmtDistance(pRtDb->distance[pRoute->index], pArgs->units), 0);
+            printStringCellValue(pArgs->outFile, fmtElevGain(pRtDb->elevation[pRoute->index], pArgs->units), 0);
+            printStringCellValue(pArgs->outFile, fmtTime(pRtDb->duration[pRoute->index]), 0);
+            printViewCellValue(pArgs->outFile, &pRoute->toughness, 0);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim720));
+            printHyperlinkCellValue(pArgs->outFile, link);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim1080));
+            printHyperlinkCellValue(pArgs->outFile, link);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vimMaster));
+            printHyperlinkCellValue(pArgs->outFile, link);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->shizUrlPfx, JSON_SV_ARG(pRoute->shiz));
+            printHyperlinkCellValue(pArgs->outFile, link);
+            if (pArgs->since != NULL)
+                printStringCellValue(pArgs->outFile, deltaName[pRoute->delta], 0);
+            fprintf(pArgs->outFile, "            </tr>\n");
+        }
     }
-    printf("        </table>\n");
-    printf("    </body>\n");
-    printf("</html>\n");
+    fprintf(pArgs->outFile, "        </table>\n");
+    fprintf(pArgs->outFile, "    </body>\n");
+    fprintf(pArgs->outFile, "</html>\n");
 }
 
 void printTextOutput(const RouteDB *pDb, const CmdArgs *pArgs)
 {
     RouteInfo *pRoute;
 
-    TAILQ_FOREACH(pRoute, &pDb->routeList, tqEntry) {
-        char link[256];
-        printf("{\n");
-        printf("    Name:            %s\n", fmtTitle(pRoute->title));
-        printf("    Country:         %s\n", fmtCountry(pRoute->location));
-        printf("    Province/State:  %s\n", fmtProvince(pRoute->location));
-        printf("    Contributor:     %s\n", pRoute->contributor);
-        printf("    Categories:      %s\n", fmtCategories(pRoute->categories));
-        printf("    Description:     %s\n", pRoute->description);
-        printf("    Distance:        %s %s\n", fmtDistance(pRoute->distance, pArgs->units), (pArgs->units == metric) ? "km" : "mi");
-        printf("    Elevation Gain:  %s %s\n", fmtElevGain(pRoute->elevation, pArgs->units), (pArgs->units == metric) ? "m" : "ft");
-        printf("    Duration:        %s\n", fmtTime(pRoute->time));
-        printf("    Toughness Score: %s\n", pRoute->toughness);
-        snprintf(link, sizeof (link), "%s%s", pDb->mp4UrlPfx, pRoute->vim720);
-        printf("    720p Video:      %s\n", link);
-        snprintf(link, sizeof (link), "%s%s", pDb->mp4UrlPfx, pRoute->vim1080);
-        printf("    1080p Video:     %s\n", link);
-        snprintf(link, sizeof (link), "%s%s", pDb->mp4UrlPfx, pRoute->vimMaster);
-        printf("    4K Video:        %s\n", link);
-        snprintf(link, sizeof (link), "%s%s", pDb->shizUrlPfx, pRoute->shiz);
-        printf("    SHIZ:            %s\n", link);
-        printf("}\n");
+    for (const RouteDB *pRtDb = pDb; pRtDb != NULL; pRtDb = pRtDb->removedDb) {
+        TAILQ_FOREACH(pRoute, &pRtDb->routeList, tqEntry) {
+            char link[256];
+            fprintf(pArgs->outFile, "{\n");
+            fprintf(pArgs->outFile, "    Name:            %s\n", fmtTitle(&pRoute->title));
+            fprintf(pArgs->outFile, "    Country:         %s\n", fmtCountry(&pRoute->location));
+            fprintf(pArgs->outFile, "    Province/State:  %s\n", fmtProvince(&pRoute->location));
+            fprintf(pArgs->outFile, "    Contributor:     " JSON_SV_FMT "\n", JSON_SV_ARG(pRoute->contributor));
+            fprintf(pArgs->outFile, "    Categories:      %s\n", fmtCategories(&pRoute->categories));
+            fprintf(pArgs->outFile, "    Description:     %s\n", fmtDescription(&pRoute->description));
+            fprintf(pArgs->outFile, "    Distance:        %s %s\n", fmtDistance(pRtDb->distance[pRoute->index], pArgs->units), (pArgs->units == metric) ? "km" : "mi");
+            fprintf(pArgs->outFile, "    Elevation Gain:  %s %s\n", fmtElevGain(pRtDb->elevation[pRoute->index], pArgs->units), (pArgs->units == metric) ? "m" : "ft");
+            fprintf(pArgs->outFile, "    Duration:        %s\n", fmtTime(pRtDb->duration[pRoute->index]));
+            fprintf(pArgs->outFile, "    Toughness Score: " JSON_SV_FMT "\n", JSON_SV_ARG(pRoute->toughness));
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim720));
+            fprintf(pArgs->outFile, "    720p Video:      %s\n", link);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim1080));
+            fprintf(pArgs->outFile, "    1080p Video:     %s\n", link);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vimMaster));
+            fprintf(pArgs->outFile, "    4K Video:        %s\n", link);
+            snprintf(link, sizeof (link), "%s" JSON_SV_FMT, pRtDb->shizUrlPfx, JSON_SV_ARG(pRoute->shiz));
+            fprintf(pArgs->outFile, "    SHIZ:            %s\n", link);
+            if (pArgs->since != NULL)
+                fprintf(pArgs->outFile, "    Status:          %s\n", deltaName[pRoute->delta]);
+            fprintf(pArgs->outFile, "}\n");
+        }
+    }
+}
+
+// The string values are output as the raw JSON text of
+// the allrides file, or whole spans of it, so they don't
+// need to be escaped.
+void printJsonOutput(const RouteDB *pDb, const CmdArgs *pArgs)
+{
+    FILE *fp = pArgs->outFile;
+    RouteInfo *pRoute;
+    int num = 0;
+
+    fprintf(fp, "[");
+    for (const RouteDB *pRtDb = pDb; pRtDb != NULL; pRtDb = pRtDb->removedDb) {
+        TAILQ_FOREACH(pRoute, &pRtDb->routeList, tqEntry) {
+            JsonStrView country = locCountry(&pRoute->location);
+            JsonStrView province = locProvince(&pRoute->location);
+
+            fprintf(fp, "%s\n    {\n", (num++ == 0) ? "" : ",");
+            fprintf(fp, "        \"id\": \"" JSON_SV_FMT "\",\n", JSON_SV_ARG(pRoute->id));
+            fprintf(fp, "        \"name\": \"" JSON_SV_FMT "\",\n", JSON_SV_ARG(pRoute->title));
+            fprintf(fp, "        \"country\": \"" JSON_SV_FMT "\",\n", JSON_SV_ARG(country));
+            fprintf(fp, "        \"province\": \"" JSON_SV_FMT "\",\n", JSON_SV_ARG(province));
+            fprintf(fp, "        \"contributor\": \"" JSON_SV_FMT "\",\n", JSON_SV_ARG(pRoute->contributor));
+            if (pRoute->categories.len != 0) {
+                fprintf(fp, "        \"categories\": " JSON_SV_FMT ",\n", JSON_SV_ARG(pRoute->categories));
+            } else {
+                fprintf(fp, "        \"categories\": [],\n");
+            }
+            fprintf(fp, "        \"description\": \"" JSON_SV_FMT "\",\n", JSON_SV_ARG(pRoute->description));
+            fprintf(fp, "        \"distance\": %s,\n", fmtDistance(pRtDb->distance[pRoute->index], pArgs->units));
+            fprintf(fp, "        \"elevationGain\": %s,\n", fmtElevGain(pRtDb->elevation[pRoute->index], pArgs->units));
+            fprintf(fp, "        \"duration\": \"%s\",\n", fmtTime(pRtDb->duration[pRoute->index]));
+            fprintf(fp, "        \"toughness\": %d,\n", pRtDb->toughness[pRoute->index]);
+            fprintf(fp, "        \"video720p\": \"%s" JSON_SV_FMT "\",\n", pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim720));
+            fprintf(fp, "        \"video1080p\": \"%s" JSON_SV_FMT "\",\n", pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vim1080));
+            fprintf(fp, "        \"video4K\": \"%s" JSON_SV_FMT "\",\n", pRtDb->mp4UrlPfx, JSON_SV_ARG(pRoute->vimMaster));
+            fprintf(fp, "        \"shiz\": \"%s" JSON_SV_FMT "\"", pRtDb->shizUrlPfx, JSON_SV_ARG(pRoute->shiz));
+            if (pArgs->since != NULL)
+                fprintf(fp, ",\n        \"status\": \"%s\"", deltaName[pRoute->delta]);
+            fprintf(fp, "\n");
+            fprintf(fp, "    }");
+        }
     }
+    fprintf(fp, "\n]\n");
 }
 
 #if 0
@@ -3,6 +3,19 @@
 #include "args.h"
 #include "routedb.h"
 
+// Format the fields of a route for the output files. The
+// formatted string is stored in a static buffer, which is
+// overwritten by the next call.
+char *fmtTitle(const JsonStrView *title);
+char *fmtCountry(const JsonStrView *locView);
+char *fmtProvince(const JsonStrView *locView);
+char *fmtCategories(const JsonStrView *categories);
+char *fmtDistance(float distance, Units units);
+char *fmtElevGain(float elevGain, Units units);
+char *fmtDescription(const JsonStrView *description);
+char *fmtTime(int time);
+
 void printCsvOutput(const RouteDB *pDb, const CmdArgs *pArgs);
 void printHttpOutput(const RouteDB *pDb, const CmdArgs *pArgs);
 void printTextOutput(const RouteDB *pDb, const CmdArgs *pArgs);
+void printJsonOutput(const RouteDB *pDb, const CmdArgs *pArgs);
@@ -1,8 +1,12 @@
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "routedb.h"
+#include "strutil.h"
 
 int rtDbInit(RouteDB *rtDb)
 {
@@ -11,21 +15,1120 @@ int rtDbInit(RouteDB *rtDb)
     return 0;
 }
 
-int rtDbAdd(RouteDB *rtDb, const RouteInfo *rtInfo)
+// Arena blocks are at least 1 MB, so even a large library
+// only needs a handful of them.
+#define RT_ARENA_BLK_SIZE   (1024 * 1024)
+#define RT_ARENA_ALIGN      (sizeof (max_align_t))
+
+struct RtArenaBlk {
+    RtArenaBlk *next;
+    size_t size;            // size of the data
+    max_align_t data[];
+};
+
+void *rtDbMalloc(RouteDB *rtDb, size_t size)
+{
+    RtArena *pArena = &rtDb->arena;
+    void *ptr;
+
+    size = (size + RT_ARENA_ALIGN - 1) & ~(RT_ARENA_ALIGN - 1);
+
+    if (size > pArena->avail) {
+        size_t blkSize = (size > RT_ARENA_BLK_SIZE) ? size : RT_ARENA_BLK_SIZE;
+        RtArenaBlk *pBlk;
+
+        // Large blocks come straight from mmap(), which
+        // returns them zeroed, so calloc() is cheap here.
+        if ((pBlk = calloc(1, sizeof (RtArenaBlk) + blkSize)) == NULL) {
+            fprintf(stderr, "ERROR: failed to alloc arena block (%zu bytes)!\n", blkSize);
+            return NULL;
+        }
+
+        pBlk->size = blkSize;
+        pBlk->next = pArena->blkList;
+        pArena->blkList = pBlk;
+        pArena->ptr = (char *) pBlk->data;
+        pArena->avail = blkSize;
+        pArena->size += blkSize;
+    }
+
+    ptr = pArena->ptr;
+    pArena->ptr += size;
+    pArena->avail -= size;
+
+    return ptr;
+}
+
+char *rtDbStrDup(RouteDB *rtDb, const char *str, size_t len)
+{
+    char *dup;
+
+    if ((dup = rtDbMalloc(rtDb, len + 1)) != NULL) {
+        memcpy(dup, str, len);
+        dup[len] = '\0';
+    }
+
+    return dup;
+}
+
+void rtDbFree(RouteDB *rtDb)
+{
+    RtArenaBlk *pBlk = rtDb->arena.blkList;
+
+    while (pBlk != NULL) {
+        RtArenaBlk *next = pBlk->next;
+        free(pBlk);
+        pBlk = next;
+    }
+
+    if (rtDb->mapAddr != NULL)
+        munmap(rtDb->mapAddr, rtDb->mapLen);
+
+    rtDbInit(rtDb);
+}
+
+int rtDbAlloc(RouteDB *rtDb, int numRecs)
 {
-    RouteInfo *pRoute;
+    size_t num = (numRecs > 0) ? numRecs : 1;
 
-    if ((pRoute = malloc(sizeof (RouteInfo))) == NULL) {
-        fprintf(stderr, "ERROR: failed to alloc route record!\n");
+    if (((rtDb->routes = rtDbMalloc(rtDb, num * sizeof (RouteInfo))) == NULL) ||
+        ((rtDb->distance = rtDbMalloc(rtDb, num * sizeof (float))) == NULL) ||
+        ((rtDb->elevation = rtDbMalloc(rtDb, num * sizeof (float))) == NULL) ||
+        ((rtDb->toughness = rtDbMalloc(rtDb, num * sizeof (int))) == NULL) ||
+        ((rtDb->duration = rtDbMalloc(rtDb, num * sizeof (int))) == NULL) ||
+        ((rtDb->updated = rtDbMalloc(rtDb, num * sizeof (int64_t))) == NULL) ||
+        ((rtDb->views = rtDbMalloc(rtDb, num * sizeof (int))) == NULL)) {
+        fprintf(stderr, "ERROR: failed to alloc route records!\n");
         return -1;
     }
 
-    *pRoute = *rtInfo;
+    rtDb->numRecs = numRecs;
+
+    return 0;
+}
 
-    // Add entry to the DB
-    TAILQ_INSERT_TAIL(&rtDb->routeList, pRoute, tqEntry);
+void rtDbSelect(RouteDB *rtDb, int index)
+{
+    // Add entry to the list
+    TAILQ_INSERT_TAIL(&rtDb->routeList, &rtDb->routes[index], tqEntry);
 
     rtDb->numRoutes++;
+}
+
+void rtDbDeselectAll(RouteDB *rtDb)
+{
+    TAILQ_INIT(&rtDb->routeList);
+    rtDb->numRoutes = 0;
+}
+
+static const size_t rtIdxFldOff[rifNum] = {
+    [rifCategories] = offsetof(RouteInfo, categoriesNorm),
+    [rifContributor] = offsetof(RouteInfo, contributorNorm),
+    [rifLocation] = offsetof(RouteInfo, locationNorm),
+};
+
+const JsonStrView *rtDbIdxField(const RouteInfo *pInfo, RtIdxFld fld)
+{
+    return (const JsonStrView *) ((const char *) pInfo + rtIdxFldOff[fld]);
+}
+
+// FNV-1a hash of the string
+static uint32_t rtStrHash(const JsonStrView *pView)
+{
+    uint32_t hash = 2166136261U;
+
+    for (size_t n = 0; n < pView->len; n++) {
+        hash ^= (uint8_t) pView->str[n];
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+static int rtStrEqual(const JsonStrView *pView1, const JsonStrView *pView2)
+{
+    return (pView1->len == pView2->len) && ((pView1->len == 0) || (memcmp(pView1->str, pView2->str, pView1->len) == 0));
+}
+
+// Build the index of the field: the distinct values are
+// collected with an open-addressing hash table, and then the
+// posting lists are filled in with a counting sort of the
+// routes by value, which keeps the routes of each value in
+// ascending order.
+static int rtBuildIndex(RouteDB *rtDb, RtIdxFld fld, int *valIds)
+{
+    RtIndex *pIdx = &rtDb->index[fld];
+    int numRecs = rtDb->numRecs;
+    size_t tblSize = 64;
+    int *tbl;
+    int *rep;
+    int numVals = 0;
+
+    while (tblSize < ((size_t) numRecs * 2))
+        tblSize *= 2;
+
+    if (((tbl = malloc(tblSize * sizeof (int))) == NULL) ||
+        ((rep = malloc((numRecs + 1) * sizeof (int))) == NULL)) {
+        fprintf(stderr, "ERROR: failed to alloc index of the route DB!\n");
+        free(tbl);
+        return -1;
+    }
+
+    memset(tbl, -1, tblSize * sizeof (int));
+
+    for (int n = 0; n < numRecs; n++) {
+        const JsonStrView *pVal = rtDbIdxField(&rtDb->routes[n], fld);
+        size_t slot = rtStrHash(pVal) & (tblSize - 1);
+        int v;
+
+        while (((v = tbl[slot]) >= 0) && !rtStrEqual(pVal, rtDbIdxField(&rtDb->routes[rep[v]], fld)))
+            slot = (slot + 1) & (tblSize - 1);
+
+        if (v < 0) {
+            // New value
+            v = tbl[slot] = numVals++;
+            rep[v] = n;
+        }
+
+        valIds[n] = v;
+    }
+
+    free(tbl);
+
+    if (((pIdx->rep = rtDbMalloc(rtDb, (numVals + 1) * sizeof (int))) == NULL) ||
+        ((pIdx->postOff = rtDbMalloc(rtDb, (numVals + 1) * sizeof (int))) == NULL) ||
+        ((pIdx->posts = rtDbMalloc(rtDb, (numRecs + 1) * sizeof (int))) == NULL)) {
+        free(rep);
+        return -1;
+    }
+
+    memcpy(pIdx->rep, rep, numVals * sizeof (int));
+    pIdx->numVals = numVals;
+    free(rep);
+
+    // Count the routes of each value, and then turn the
+    // counts into the start of each posting list.
+    for (int n = 0; n < numRecs; n++) {
+        pIdx->postOff[valIds[n] + 1]++;
+    }
+    for (int v = 0; v < numVals; v++) {
+        pIdx->postOff[v + 1] += pIdx->postOff[v];
+    }
+    for (int n = 0; n < numRecs; n++) {
+        pIdx->posts[pIdx->postOff[valIds[n]]++] = n;
+    }
+
+    // Filling in the lists left each offset at the start
+    // of the next list, so shift them back.
+    memmove(&pIdx->postOff[1], &pIdx->postOff[0], numVals * sizeof (int));
+    pIdx->postOff[0] = 0;
+
+    return 0;
+}
+
+static const size_t rtTriFldOff[rtrNum] = {
+    [rtrTitle] = offsetof(RouteInfo, titleNorm),
+    [rtrVim1080] = offsetof(RouteInfo, vim1080Norm),
+    [rtrShiz] = offsetof(RouteInfo, shizNorm),
+};
+
+const JsonStrView *rtDbTriField(const RouteInfo *pInfo, RtTriFld fld)
+{
+    return (const JsonStrView *) ((const char *) pInfo + rtTriFldOff[fld]);
+}
+
+// Trigram of the string at 'p'
+static inline uint32_t rtTrigram(const char *p)
+{
+    return ((uint32_t) (uint8_t) p[0] << 16) | ((uint32_t) (uint8_t) p[1] << 8) | (uint8_t) p[2];
+}
+
+// Entry of the hash table used to collect the trigrams
+typedef struct RtTriEnt {
+    uint32_t key;       // trigram | RT_TRI_USED, or 0 if free
+    int count;          // number of routes with the trigram
+    int last;           // last route with the trigram
+    int idx;            // index of the trigram in the sorted list
+} RtTriEnt;
+
+#define RT_TRI_USED     0x80000000
+
+typedef struct RtTriTbl {
+    RtTriEnt *ents;
+    size_t size;        // power of 2
+    int num;            // number of entries in use
+} RtTriTbl;
+
+static RtTriEnt *rtTriFind(RtTriTbl *pTbl, uint32_t tri)
+{
+    uint32_t key = tri | RT_TRI_USED;
+    size_t slot = (tri * 2654435761U) & (pTbl->size - 1);
+
+    while ((pTbl->ents[slot].key != key) && (pTbl->ents[slot].key != 0))
+        slot = (slot + 1) & (pTbl->size - 1);
+
+    return &pTbl->ents[slot];
+}
+
+// Get the entry of the trigram, adding it if needed
+static RtTriEnt *rtTriAdd(RtTriTbl *pTbl, uint32_t tri)
+{
+    RtTriEnt *pEnt;
+
+    // Keep the load factor under 1/2
+    if (((pTbl->num + 1) * 2) > pTbl->size) {
+        RtTriTbl newTbl = { .size = (pTbl->size * 2), .num = pTbl->num };
+
+        if ((newTbl.ents = calloc(newTbl.size, sizeof (RtTriEnt))) == NULL) {
+            fprintf(stderr, "ERROR: failed to alloc trigram table!\n");
+            return NULL;
+        }
+
+        for (size_t n = 0; n < pTbl->size; n++) {
+            if (pTbl->ents[n].key != 0)
+                *rtTriFind(&newTbl, (pTbl->ents[n].key & ~RT_TRI_USED)) = pTbl->ents[n];
+        }
+
+        free(pTbl->ents);
+        *pTbl = newTbl;
+    }
+
+    if ((pEnt = rtTriFind(pTbl, tri))->key == 0) {
+        pEnt->key = tri | RT_TRI_USED;
+        pEnt->last = -1;
+        pTbl->num++;
+    }
+
+    return pEnt;
+}
+
+static int rtCmpUint32(const void *a, const void *b)
+{
+    uint32_t u1 = *(const uint32_t *) a;
+    uint32_t u2 = *(const uint32_t *) b;
+
+    return (u1 > u2) - (u1 < u2);
+}
+
+// Build the trigram index of the field in two passes over the
+// routes: the first one collects the distinct trigrams and the
+// number of routes that have each one, and the second one fills
+// in the posting lists. Since the routes are visited in order,
+// a route is only added once to each list, and the lists come
+// out sorted.
+static int rtBuildTriIndex(RouteDB *rtDb, RtTriFld fld)
+{
+    RtTriIndex *pIdx = &rtDb->triIndex[fld];
+    RtTriTbl tbl = { .size = 1024 };
+    int numPosts = 0;
+    int s = -1;
+
+    if ((tbl.ents = calloc(tbl.size, sizeof (RtTriEnt))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc trigram table!\n");
+        return -1;
+    }
+
+    for (int n = 0; n < rtDb->numRecs; n++) {
+        const JsonStrView *pVal = rtDbTriField(&rtDb->routes[n], fld);
+
+        for (size_t i = 0; (i + 3) <= pVal->len; i++) {
+            RtTriEnt *pEnt;
+
+            if ((pEnt = rtTriAdd(&tbl, rtTrigram(&pVal->str[i]))) == NULL)
+                goto done;
+
+            if (pEnt->last != n) {
+                pEnt->last = n;
+                pEnt->count++;
+                numPosts++;
+            }
+        }
+    }
+
+    if (((pIdx->tris = rtDbMalloc(rtDb, (tbl.num + 1) * sizeof (uint32_t))) == NULL) ||
+        ((pIdx->postOff = rtDbMalloc(rtDb, (tbl.num + 1) * sizeof (int))) == NULL) ||
+        ((pIdx->posts = rtDbMalloc(rtDb, (numPosts + 1) * sizeof (int))) == NULL)) {
+        goto done;
+    }
+
+    // Sort the trigrams, and lay out their posting lists
+    // in the same order.
+    pIdx->numTris = 0;
+    for (size_t n = 0; n < tbl.size; n++) {
+        if (tbl.ents[n].key != 0)
+            pIdx->tris[pIdx->numTris++] = tbl.ents[n].key & ~RT_TRI_USED;
+    }
+    qsort(pIdx->tris, pIdx->numTris, sizeof (uint32_t), rtCmpUint32);
+
+    for (int t = 0; t < pIdx->numTris; t++) {
+        RtTriEnt *pEnt = rtTriFind(&tbl, pIdx->tris[t]);
+        pIdx->postOff[t + 1] = pIdx->postOff[t] + pEnt->count;
+        pEnt->idx = pIdx->postOff[t];   // next free slot of the list
+        pEnt->last = -1;
+    }
+
+    for (int n = 0; n < rtDb->numRecs; n++) {
+        const JsonStrView *pVal = rtDbTriField(&rtDb->routes[n], fld);
+
+        for (size_t i = 0; (i + 3) <= pVal->len; i++) {
+            RtTriEnt *pEnt = rtTriFind(&tbl, rtTrigram(&pVal->str[i]));
+
+            if (pEnt->last != n) {
+                pEnt->last = n;
+                pIdx->posts[pEnt->idx++] = n;
+            }
+        }
+    }
+
+    s = 0;
+
+done:
+    free(tbl.ents);
+    return s;
+}
+
+// Map a float to an unsigned integer with the same order
+static inline uint32_t rtFloatKey(float val)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &val, sizeof (bits));
+
+    return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+// Build the range index of the column, by sorting the routes
+// by their values with a LSD radix sort of the float keys.
+static int rtBuildRangeIndex(RouteDB *rtDb, RtRngFld fld)
+{
+    RtRangeIdx *pIdx = &rtDb->rangeIndex[fld];
+    int numRecs = rtDb->numRecs;
+    uint32_t *keys, *tmpKeys;
+    int *ids, *tmpIds;
+    void *buf;
+
+    if (((pIdx->vals = rtDbMalloc(rtDb, (numRecs + 1) * sizeof (float))) == NULL) ||
+        ((pIdx->ids = rtDbMalloc(rtDb, (numRecs + 1) * sizeof (int))) == NULL)) {
+        return -1;
+    }
+
+    if ((buf = malloc((numRecs + 1) * 2 * (sizeof (uint32_t) + sizeof (int)))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc range index buffers!\n");
+        return -1;
+    }
+    keys = buf;
+    tmpKeys = keys + (numRecs + 1);
+    ids = (int *) (tmpKeys + (numRecs + 1));
+    tmpIds = ids + (numRecs + 1);
+
+    for (int n = 0; n < numRecs; n++) {
+        float val = (fld == rrgDistance) ? rtDb->distance[n] :
+                    (fld == rrgElevation) ? rtDb->elevation[n] : rtDb->duration[n];
+        keys[n] = rtFloatKey(val);
+        ids[n] = n;
+    }
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        int count[256] = {0};
+        int off = 0;
+
+        for (int n = 0; n < numRecs; n++) {
+            count[(keys[n] >> shift) & 0xff]++;
+        }
+        for (int d = 0; d < 256; d++) {
+            int c = count[d];
+            count[d] = off;
+            off += c;
+        }
+        for (int n = 0; n < numRecs; n++) {
+            int pos = count[(keys[n] >> shift) & 0xff]++;
+            tmpKeys[pos] = keys[n];
+            tmpIds[pos] = ids[n];
+        }
+
+        uint32_t *swapKeys = keys;
+        int *swapIds = ids;
+        keys = tmpKeys;
+        ids = tmpIds;
+        tmpKeys = swapKeys;
+        tmpIds = swapIds;
+    }
+
+    for (int n = 0; n < numRecs; n++) {
+        int id = ids[n];
+        pIdx->vals[n] = (fld == rrgDistance) ? rtDb->distance[id] :
+                        (fld == rrgElevation) ? rtDb->elevation[id] : rtDb->duration[id];
+        pIdx->ids[n] = id;
+    }
+
+    free(buf);
+
+    return 0;
+}
+
+// Index of the first value of the index that isn't less
+// than 'val' or, if 'upper' is set, greater than 'val'.
+static int rtRangeBound(const RtRangeIdx *pIdx, int num, double val, int upper)
+{
+    int lo = 0, hi = num;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (upper ? (pIdx->vals[mid] <= val) : (pIdx->vals[mid] < val)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int rtDbRangeLookup(const RouteDB *rtDb, RtRngFld fld, double min, double max, const int **pIds)
+{
+    const RtRangeIdx *pIdx = &rtDb->rangeIndex[fld];
+    int first = rtRangeBound(pIdx, rtDb->numRecs, min, 0);
+    int end = rtRangeBound(pIdx, rtDb->numRecs, max, 1);
+
+    *pIds = &pIdx->ids[first];
+
+    return (end > first) ? (end - first) : 0;
+}
+
+int rtDbBuildIndexes(RouteDB *rtDb)
+{
+    int *valIds;
+    int s = 0;
+
+    if ((valIds = malloc((rtDb->numRecs + 1) * sizeof (int))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc index of the route DB!\n");
+        return -1;
+    }
+
+    for (int fld = 0; (s == 0) && (fld < rifNum); fld++) {
+        s = rtBuildIndex(rtDb, fld, valIds);
+    }
+
+    free(valIds);
+
+    for (int fld = 0; (s == 0) && (fld < rtrNum); fld++) {
+        s = rtBuildTriIndex(rtDb, fld);
+    }
+
+    for (int fld = 0; (s == 0) && (fld < rrgNum); fld++) {
+        s = rtBuildRangeIndex(rtDb, fld);
+    }
+
+    if ((s == 0) && (rtDb->idHash.slots == NULL))
+        s = rtDbBuildIdHash(rtDb);
+
+    if ((s == 0) && (rtDb->hash == NULL))
+        s = rtDbHashRoutes(rtDb);
+
+    rtDb->indexed = (s == 0);
+
+    return s;
+}
+
+static int rtCmpInt(const void *a, const void *b)
+{
+    int i1 = *(const int *) a;
+    int i2 = *(const int *) b;
+
+    return (i1 > i2) - (i1 < i2);
+}
+
+int rtDbIdxLookup(const RouteDB *rtDb, RtIdxFld fld, const char *query, int **pList)
+{
+    const RtIndex *pIdx = &rtDb->index[fld];
+    size_t qLen = strlen(query);
+    int *list;
+    int num = 0;
+    int numMatch = 0;
+
+    if ((list = malloc((rtDb->numRecs + 1) * sizeof (int))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc route list!\n");
+        return -1;
+    }
+
+    for (int v = 0; v < pIdx->numVals; v++) {
+        if (strFind(rtDbIdxField(&rtDb->routes[pIdx->rep[v]], fld), query, qLen) != NULL) {
+            int len = pIdx->postOff[v + 1] - pIdx->postOff[v];
+            memcpy(&list[num], &pIdx->posts[pIdx->postOff[v]], len * sizeof (int));
+            num += len;
+            numMatch++;
+        }
+    }
+
+    // The posting lists are disjoint, so merging them only
+    // requires sorting them when more than one matched.
+    if (numMatch > 1)
+        qsort(list, num, sizeof (int), rtCmpInt);
+
+    *pList = list;
+
+    return num;
+}
+
+// Get the posting list of the trigram; returns its length
+static int rtTriPosts(const RtTriIndex *pIdx, uint32_t tri, const int **pPosts)
+{
+    int lo = 0, hi = pIdx->numTris;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (pIdx->tris[mid] < tri) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ((lo == pIdx->numTris) || (pIdx->tris[lo] != tri)) {
+        *pPosts = NULL;
+        return 0;
+    }
+
+    *pPosts = &pIdx->posts[pIdx->postOff[lo]];
+
+    return pIdx->postOff[lo + 1] - pIdx->postOff[lo];
+}
+
+int rtDbTriLookup(const RouteDB *rtDb, RtTriFld fld, const char *query, int **pList)
+{
+    const RtTriIndex *pIdx = &rtDb->triIndex[fld];
+    size_t qLen = strlen(query);
+    const int *posts;
+    int *list;
+    int num, minNum;
+    size_t minPos = 0;
+
+    *pList = NULL;
+
+    if (qLen < 3)
+        return rtDb->numRecs;
+
+    // Start with the shortest posting list...
+    minNum = rtTriPosts(pIdx, rtTrigram(query), &posts);
+    for (size_t i = 1; (minNum > 0) && ((i + 3) <= qLen); i++) {
+        int len = rtTriPosts(pIdx, rtTrigram(&query[i]), &posts);
+        if (len < minNum) {
+            minNum = len;
+            minPos = i;
+        }
+    }
+
+    if ((list = malloc((minNum + 1) * sizeof (int))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc route list!\n");
+        return -1;
+    }
+
+    num = rtTriPosts(pIdx, rtTrigram(&query[minPos]), &posts);
+    if (num > 0)
+        memcpy(list, posts, num * sizeof (int));
+
+    // ... and intersect it with the other ones
+    for (size_t i = 0; (num > 0) && ((i + 3) <= qLen); i++) {
+        int len, n1 = 0, n2 = 0, n = 0;
+
+        if (i == minPos)
+            continue;
+
+        len = rtTriPosts(pIdx, rtTrigram(&query[i]), &posts);
+        while ((n1 < num) && (n2 < len)) {
+            if (list[n1] < posts[n2]) {
+                n1++;
+            } else if (list[n1] > posts[n2]) {
+                n2++;
+            } else {
+                list[n++] = list[n1++];
+                n2++;
+            }
+        }
+        num = n;
+    }
+
+    // The index may come from a snapshot, so make sure
+    // the candidates are valid routes.
+    for (int n = 0; n < num; n++) {
+        if ((list[n] < 0) || (list[n] >= rtDb->numRecs)) {
+            fprintf(stderr, "ERROR: corrupted trigram index!\n");
+            free(list);
+            return -1;
+        }
+    }
+
+    *pList = list;
+
+    return num;
+}
+
+// Type of the route fields
+typedef enum RtFldTyp {
+    rftObject = 1,  // embedded object with more fields
+    rftString = 2,  // string value
+    rftArray = 3,   // array value, kept as JSON text
+    rftNumber = 4,  // number value, kept as JSON text
+} RtFldTyp;
+
+// A route field is described by the path of its key in the
+// route object, its type, and the RouteInfo member where its
+// value is stored. The parent of a nested field must appear
+// in the table before the field itself.
+typedef struct RtField {
+    const char *path;   // key path; e.g. "meta.loc"
+    RtFldTyp type;      // type of the value
+    size_t offset;      // offset of the RouteInfo member
+    int optional;       // the field may be missing
+} RtField;
+
+#define RT_FLD(path, type, member)  { path, type, offsetof(RouteInfo, member), 0 }
+#define RT_OPT(path, type, member)  { path, type, offsetof(RouteInfo, member), 1 }
+#define RT_OBJ(path)                { path, rftObject, 0, 0 }
+
+static const RtField rtFields[] = {
+    RT_FLD("_id", rftString, id),
+    RT_FLD("t", rftString, title),
+    RT_OBJ("meta"),
+    RT_FLD("meta.loc", rftString, location),
+    RT_FLD("meta.dur", rftString, duration),
+    RT_FLD("meta.dis", rftString, distance),
+    RT_FLD("meta.des", rftString, description),
+    RT_FLD("meta.ele", rftString, elevation),
+    RT_FLD("meta.con", rftString, contributor),
+    RT_FLD("meta.tou", rftString, toughness),
+    RT_FLD("meta.cat", rftArray, categories),
+    RT_OBJ("vimMaster"),
+    RT_FLD("vimMaster.file", rftString, vimMaster),
+    RT_OBJ("vim1080"),
+    RT_FLD("vim1080.file", rftString, vim1080),
+    RT_OBJ("vim720"),
+    RT_FLD("vim720.file", rftString, vim720),
+    RT_OBJ("a"),
+    RT_FLD("a.file", rftString, shiz),
+    RT_OPT("u", rftNumber, updated),
+    RT_OPT("views", rftNumber, views),
+};
+
+#define RT_NUM_FIELDS   (sizeof (rtFields) / sizeof (rtFields[0]))
+#define RT_FLD_BIT(n)   ((uint32_t) 1 << (n))
+
+_Static_assert((RT_NUM_FIELDS <= 32), "Too many route fields!");
+
+// Info derived from the field table at startup
+typedef struct RtFldInfo {
+    int parent;         // index of the parent field, or -1 if none
+    const char *leaf;   // last key in the path
+    size_t leafLen;     // length of the last key
+} RtFldInfo;
+
+static RtFldInfo rtFldInfo[RT_NUM_FIELDS];
+
+// The key paths of the fields are hashed into a table with
+// no collisions (i.e. a perfect hash) by picking a suitable
+// seed at startup. The hash of a nested key path is computed
+// incrementally from the hash of its parent's path, so each
+// member of the route object costs a single hash lookup.
+#define RT_HASH_BITS    6
+#define RT_HASH_SIZE    (1 << RT_HASH_BITS)
+#define RT_HASH_TRIES   100000
+
+static int8_t rtHashTbl[RT_HASH_SIZE];
+static uint32_t rtHashSeed;
+
+// FNV-1a hash
+static uint32_t rtHash(uint32_t hash, const char *str, size_t len)
+{
+    for (size_t n = 0; n < len; n++) {
+        hash ^= (uint8_t) str[n];
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+// The low bits of an FNV-1a hash only depend on the low bits
+// of the seed and of the characters, so the slot is taken from
+// the high bits.
+static inline uint32_t rtHashSlot(uint32_t hash)
+{
+    return hash >> (32 - RT_HASH_BITS);
+}
+
+__attribute__((constructor))
+static void rtFieldInit(void)
+{
+    for (int n = 0; n < RT_NUM_FIELDS; n++) {
+        const char *path = rtFields[n].path;
+        const char *dot = strrchr(path, '.');
+        RtFldInfo *pFi = &rtFldInfo[n];
+
+        pFi->parent = -1;
+        pFi->leaf = (dot != NULL) ? (dot + 1) : path;
+        pFi->leafLen = strlen(pFi->leaf);
+        if (dot != NULL) {
+            size_t len = dot - path;
+            for (int p = 0; p < n; p++) {
+                if ((strlen(rtFields[p].path) == len) && (memcmp(rtFields[p].path, path, len) == 0)) {
+                    pFi->parent = p;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Try a pseudo-random sequence of seeds, as the hashes
+    // of consecutive seeds are too much alike.
+    for (uint32_t seed = 2166136261U, t = 0; t < RT_HASH_TRIES; seed = (seed * 1664525) + 1013904223, t++) {
+        int n;
+
+        memset(rtHashTbl, -1, sizeof (rtHashTbl));
+        for (n = 0; n < RT_NUM_FIELDS; n++) {
+            const char *path = rtFields[n].path;
+            uint32_t slot = rtHashSlot(rtHash(seed, path, strlen(path)));
+            if (rtHashTbl[slot] >= 0)
+                break;  // collision
+            rtHashTbl[slot] = n;
+        }
+        if (n == RT_NUM_FIELDS) {
+            rtHashSeed = seed;
+            return;
+        }
+    }
+
+    fprintf(stderr, "ERROR: can't build the route field hash table!\n");
+    abort();
+}
+
+typedef struct RtParseCtx {
+    RouteInfo *pInfo;
+    int parent;         // field index of the enclosing object, or -1
+    uint32_t hash;      // hash of the key path of the enclosing object
+    uint32_t found;     // bitmask of the fields found
+} RtParseCtx;
+
+static int rtParseMember(const JsonMember *pMbr, void *arg)
+{
+    RtParseCtx *pCtx = arg;
+    uint32_t hash = rtHash(pCtx->hash, pMbr->key.str, pMbr->key.len);
+    int idx = rtHashTbl[rtHashSlot(hash)];
+    const RtField *pFld;
+    const RtFldInfo *pFi;
+    JsonStrView *pView;
+
+    if (idx < 0) {
+        // Not a field we care about
+        return 0;
+    }
+
+    pFld = &rtFields[idx];
+    pFi = &rtFldInfo[idx];
+    pView = (JsonStrView *) ((char *) pCtx->pInfo + pFld->offset);
+
+    if ((pFi->parent != pCtx->parent) ||
+        (pFi->leafLen != pMbr->key.len) ||
+        (memcmp(pFi->leaf, pMbr->key.str, pFi->leafLen) != 0)) {
+        // Hash hit on a key we don't care about
+        return 0;
+    }
+
+    if (pFld->type == rftObject) {
+        if (pMbr->type == jtObject) {
+            RtParseCtx subCtx = { .pInfo = pCtx->pInfo, .parent = idx, .hash = rtHash(hash, ".", 1) };
+            if (jsonObjectForEachMember(&pMbr->value, rtParseMember, &subCtx) != 0)
+                return -1;
+            pCtx->found |= subCtx.found | RT_FLD_BIT(idx);
+        }
+    } else if (pFld->type == rftString) {
+        if (jsonMemberStrView(pMbr, pView) == 0) {
+            pCtx->found |= RT_FLD_BIT(idx);
+        }
+    } else if (pFld->type == rftArray) {
+        if (pMbr->type == jtArray) {
+            pView->str = pMbr->value.start;
+            pView->len = pMbr->value.end - pMbr->value.start + 1;
+            pCtx->found |= RT_FLD_BIT(idx);
+        }
+    } else if (pFld->type == rftNumber) {
+        if (pMbr->type == jtPrim) {
+            pView->str = pMbr->value.start;
+            pView->len = pMbr->value.end - pMbr->value.start + 1;
+            pCtx->found |= RT_FLD_BIT(idx);
+        }
+    }
+
+    return 0;
+}
+
+// Parse the number in the string view; if the view is
+// empty, or it doesn't start with a number, zero is used.
+static double rtParseNum(const JsonStrView *pView)
+{
+    double val = 0.0;
+
+    if (pView->str != NULL)
+        jsonParseDouble(pView->str, pView->len, &val);
+
+    return val;
+}
+
+int rtDbExtractRoute(RouteDB *rtDb, int index, const JsonObject *pObj)
+{
+    RouteInfo *pInfo = &rtDb->routes[index];
+    RtParseCtx ctx = { .pInfo = pInfo, .parent = -1, .hash = rtHashSeed };
+
+    memset(pInfo, 0, sizeof (RouteInfo));
+    pInfo->index = index;
+
+    if (jsonObjectForEachMember(pObj, rtParseMember, &ctx) != 0)
+        return -1;
+
+    // All the fields are required, except the optional ones
+    // and the ones in an embedded object that is missing.
+    for (int n = 0; n < RT_NUM_FIELDS; n++) {
+        int parent = rtFldInfo[n].parent;
+        if (!(ctx.found & RT_FLD_BIT(n)) && (rtFields[n].type != rftObject) && !rtFields[n].optional &&
+            ((parent < 0) || (ctx.found & RT_FLD_BIT(parent)))) {
+            fprintf(stderr, "ERROR: failed to get \"%s\" value!\n", rtFields[n].path);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void rtDbParseCol(RouteDB *rtDb, int index, RtRngFld fld)
+{
+    const RouteInfo *pInfo = &rtDb->routes[index];
+    time_t time = 0;
+
+    if (fld == rrgDistance) {
+        rtDb->distance[index] = rtParseNum(&pInfo->distance);
+    } else if (fld == rrgElevation) {
+        rtDb->elevation[index] = rtParseNum(&pInfo->elevation);
+    } else {
+        if (pInfo->duration.str != NULL)
+            jsonParseTime(pInfo->duration.str, pInfo->duration.len, &time);
+        rtDb->duration[index] = time;
+    }
+}
+
+void rtDbParseCols(RouteDB *rtDb, int index)
+{
+    const RouteInfo *pInfo = &rtDb->routes[index];
+
+    // Parse the numeric fields into their columns
+    for (int fld = 0; fld < rrgNum; fld++) {
+        rtDbParseCol(rtDb, index, fld);
+    }
+    rtDb->toughness[index] = rtParseNum(&pInfo->toughness);
+    rtDb->updated[index] = rtParseNum(&pInfo->updated);
+    rtDb->views[index] = rtParseNum(&pInfo->views);
+}
+
+int rtDbParseRoute(RouteDB *rtDb, int index, const JsonObject *pObj)
+{
+    if (rtDbExtractRoute(rtDb, index, pObj) != 0)
+        return -1;
+
+    rtDbParseCols(rtDb, index);
+
+    return 0;
+}
+
+// The fields with a normalized copy, and where it goes
+static const struct {
+    size_t off;
+    size_t normOff;
+} rtNormFields[rnfNum] = {
+    [rnfCategories] = { offsetof(RouteInfo, categories), offsetof(RouteInfo, categoriesNorm) },
+    [rnfContributor] = { offsetof(RouteInfo, contributor), offsetof(RouteInfo, contributorNorm) },
+    [rnfLocation] = { offsetof(RouteInfo, location), offsetof(RouteInfo, locationNorm) },
+    [rnfShiz] = { offsetof(RouteInfo, shiz), offsetof(RouteInfo, shizNorm) },
+    [rnfTitle] = { offsetof(RouteInfo, title), offsetof(RouteInfo, titleNorm) },
+    [rnfVim1080] = { offsetof(RouteInfo, vim1080), offsetof(RouteInfo, vim1080Norm) },
+};
+
+const JsonStrView *rtDbNormView(const RouteInfo *pInfo, RtNormFld fld)
+{
+    return (const JsonStrView *) ((const char *) pInfo + rtNormFields[fld].normOff);
+}
+
+// Serializes the allocations from the arena of the DB made
+// by the threads that normalize the routes
+static pthread_mutex_t rtNormLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The normalized copy of a field is never longer than the
+// field, so the copies of all the routes in the range fit in
+// a single buffer sized after the fields.
+int rtDbNormBufAlloc(RouteDB *rtDb, int first, int count, RtNormBuf *pBuf)
+{
+    size_t bufLen = 0;
+
+    for (int n = first; n < (first + count); n++) {
+        const RouteInfo *pInfo = &rtDb->routes[n];
+        for (int f = 0; f < rnfNum; f++) {
+            bufLen += ((const JsonStrView *) ((const char *) pInfo + rtNormFields[f].off))->len;
+        }
+    }
+
+    pthread_mutex_lock(&rtNormLock);
+    pBuf->ptr = rtDbMalloc(rtDb, (bufLen + 1));
+    pthread_mutex_unlock(&rtNormLock);
+
+    return (pBuf->ptr != NULL) ? 0 : -1;
+}
+
+const JsonStrView *rtDbNormField(RtNormBuf *pBuf, RouteInfo *pInfo, RtNormFld fld)
+{
+    const JsonStrView *pView = (const JsonStrView *) ((const char *) pInfo + rtNormFields[fld].off);
+    JsonStrView *pNorm = (JsonStrView *) ((char *) pInfo + rtNormFields[fld].normOff);
+
+    // A missing field stays missing
+    if ((pNorm->str == NULL) && (pView->str != NULL)) {
+        pNorm->str = pBuf->ptr;
+        pNorm->len = strNorm(pView->str, pView->len, 1, pBuf->ptr);
+        pBuf->ptr += pNorm->len;
+    }
+
+    return pNorm;
+}
+
+void rtDbNormRoute(RtNormBuf *pBuf, RouteInfo *pInfo)
+{
+    for (int f = 0; f < rnfNum; f++) {
+        rtDbNormField(pBuf, pInfo, f);
+    }
+}
+
+int rtDbNormRoutes(RouteDB *rtDb, int first, int count)
+{
+    RtNormBuf buf;
+
+    if (rtDbNormBufAlloc(rtDb, first, count, &buf) != 0)
+        return -1;
+
+    for (int n = first; n < (first + count); n++) {
+        rtDbNormRoute(&buf, &rtDb->routes[n]);
+    }
+
+    return 0;
+}
+
+int rtDbBuildIdHash(RouteDB *rtDb)
+{
+    RtIdHash *pHash = &rtDb->idHash;
+    int size = 16;
+
+    while (size < (2 * rtDb->numRecs))
+        size *= 2;
+
+    if ((pHash->slots = rtDbMalloc(rtDb, size * sizeof (int))) == NULL)
+        return -1;
+    memset(pHash->slots, -1, size * sizeof (int));
+    pHash->size = size;
+
+    // If a route ID is repeated, the first route wins
+    for (int n = 0; n < rtDb->numRecs; n++) {
+        const JsonStrView *pId = &rtDb->routes[n].id;
+        uint32_t slot = rtHash(2166136261U, pId->str, pId->len) & (size - 1);
+
+        while (pHash->slots[slot] >= 0) {
+            const JsonStrView *pSlotId = &rtDb->routes[pHash->slots[slot]].id;
+            if ((pSlotId->len == pId->len) && (memcmp(pSlotId->str, pId->str, pId->len) == 0))
+                break;
+            slot = (slot + 1) & (size - 1);
+        }
+
+        if (pHash->slots[slot] < 0)
+            pHash->slots[slot] = n;
+    }
+
+    return 0;
+}
+
+int rtDbIdLookup(const RouteDB *rtDb, const char *id, size_t len)
+{
+    const RtIdHash *pHash = &rtDb->idHash;
+    uint32_t slot;
+
+    if (pHash->size == 0)
+        return -1;
+
+    // The table may come from a snapshot, so the probe
+    // sequence and the route indexes are bounded.
+    slot = rtHash(2166136261U, id, len) & (pHash->size - 1);
+    for (int n = 0; n < pHash->size; n++) {
+        int index = pHash->slots[slot];
+        if ((index < 0) || (index >= rtDb->numRecs))
+            break;
+        const JsonStrView *pId = &rtDb->routes[index].id;
+        if ((pId->len == len) && (memcmp(pId->str, id, len) == 0))
+            return index;
+        slot = (slot + 1) & (pHash->size - 1);
+    }
+
+    return -1;
+}
+
+// FNV-1a hash of the bytes, preceded by their number
+static uint64_t rtHashBytes(uint64_t hash, const char *str, size_t len)
+{
+    hash ^= len;
+    hash *= 1099511628211ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) str[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+int rtDbHashRoutes(RouteDB *rtDb)
+{
+    char *buf = NULL;
+    size_t bufLen = 0;
+
+    if ((rtDb->hash = rtDbMalloc(rtDb, (rtDb->numRecs + 1) * sizeof (uint64_t))) == NULL)
+        return -1;
+
+    // FNV-1a hash of the decoded values of the fields, each
+    // one preceded by its length, so that moving text from
+    // one field to the next changes the hash, but the way
+    // the text is escaped in the JSON file doesn't.
+    for (int n = 0; n < rtDb->numRecs; n++) {
+        const RouteInfo *pInfo = &rtDb->routes[n];
+        uint64_t hash = 14695981039346656037ULL;
+
+        for (int f = 0; f < RT_NUM_FIELDS; f++) {
+            const JsonStrView *pView;
+
+            if ((rtFields[f].type == rftObject) || (rtFields[f].offset == offsetof(RouteInfo, views)))
+                continue;
+
+            pView = (const JsonStrView *) ((const char *) pInfo + rtFields[f].offset);
+            if ((pView->len == 0) || (memchr(pView->str, '\\', pView->len) == NULL)) {
+                hash = rtHashBytes(hash, pView->str, pView->len);
+                continue;
+            }
+
+            if (pView->len > bufLen) {
+                char *newBuf = realloc(buf, pView->len);
+                if (newBuf == NULL) {
+                    fprintf(stderr, "ERROR: failed to alloc route hash buffer!\n");
+                    free(buf);
+                    return -1;
+                }
+                buf = newBuf;
+                bufLen = pView->len;
+            }
+            hash = rtHashBytes(hash, buf, strUnescape(pView->str, pView->len, buf));
+        }
+
+        rtDb->hash[n] = hash;
+    }
+
+    free(buf);
 
     return 0;
 }
@@ -2,44 +2,309 @@
 
 #include <sys/queue.h>
 
+#include "json.h"
+
 __BEGIN_DECLS
 
+// The string fields of a route are views into the text of
+// the allrides file, so the file data must be kept around
+// for as long as the route records are in use.
+
+// Change of a route since a previous version of the library
+typedef enum RtDelta {
+    rdlNone = 0,
+    rdlAdded = 1,
+    rdlChanged = 2,
+    rdlRemoved = 3,
+} RtDelta;
+
 typedef struct RouteInfo {
     TAILQ_ENTRY(RouteInfo) tqEntry;
 
-    char *categories;   //
-    char *contributor;  // Contributor
-    char *description;  // Description
-    char *distance;     // Distance (in km)
-    char *duration;     // Duration of the video (HH:MM:SS)
-    char *elevation;    // Elevation gain (in meters)
-    char *id;           // Route ID
-    char *location;     // Location
-    char *shiz;         // SHIZ control file
-    char *title;        // Title
-    char *toughness;    // Toughness score
-    char *vimMaster;    // 4K video file
-    char *vim1080;      // 1080p video file
-    char *vim720;       // 720p video file
-
-    int time;           // duration (in seconds)
+    JsonStrView categories;     // Categories (JSON array)
+    JsonStrView contributor;    // Contributor
+    JsonStrView description;    // Description (with escape sequences)
+    JsonStrView distance;       // Distance (in km)
+    JsonStrView duration;       // Duration of the video (HH:MM:SS)
+    JsonStrView elevation;      // Elevation gain (in meters)
+    JsonStrView id;             // Route ID
+    JsonStrView location;       // Location
+    JsonStrView shiz;           // SHIZ control file
+    JsonStrView title;          // Title
+    JsonStrView toughness;      // Toughness score
+    JsonStrView vimMaster;      // 4K video file
+    JsonStrView vim1080;        // 1080p video file
+    JsonStrView vim720;         // 720p video file
+    JsonStrView updated;        // Last update time (JSON number)
+    JsonStrView views;          // Number of views (JSON number)
+
+    // Normalized copies of the fields searched by the match
+    // filters (see strNorm()), which are owned by the DB.
+    JsonStrView categoriesNorm;
+    JsonStrView contributorNorm;
+    JsonStrView locationNorm;
+    JsonStrView shizNorm;
+    JsonStrView titleNorm;
+    JsonStrView vim1080Norm;
+
+    int index;          // index of the route in the DB columns
+    RtDelta delta;      // change since the previous version (see --since)
 } RouteInfo;
 
+// The memory of the DB is carved out of a list of large
+// blocks with a bump pointer, so building the DB doesn't
+// need a malloc per route, and freeing it only needs to
+// release the blocks.
+typedef struct RtArenaBlk RtArenaBlk;
+
+typedef struct RtArena {
+    RtArenaBlk *blkList;    // list of blocks, newest first
+    char *ptr;              // free space in the current block
+    size_t avail;           // size of the free space
+    size_t size;            // total size of the blocks
+} RtArena;
+
+// Fields of the route records with an inverted index
+typedef enum RtIdxFld {
+    rifCategories = 0,  // the whole "cat" array
+    rifContributor = 1,
+    rifLocation = 2,    // country and province
+    rifNum = 3,
+} RtIdxFld;
+
+// Inverted index of a route field: the distinct normalized
+// values of the field (see strNorm()) and, for each value, the
+// sorted list of routes that have it. The values are the views
+// of a route that has them, so they don't take any extra space;
+// and since each route has a single value, the posting lists
+// of all the values add up to the number of routes.
+typedef struct RtIndex {
+    int numVals;        // number of distinct values
+    int *rep;           // a route that has the value
+    int *postOff;       // start of the value's posting list
+    int *posts;         // the posting lists, back to back
+} RtIndex;
+
+// Fields of the route records with a trigram index
+typedef enum RtTriFld {
+    rtrTitle = 0,
+    rtrVim1080 = 1,
+    rtrShiz = 2,
+    rtrNum = 3,
+} RtTriFld;
+
+// Trigram index of a route field: for each distinct trigram
+// (i.e. sequence of 3 bytes) of the normalized values of the
+// field, the sorted list of the routes that have it.
+typedef struct RtTriIndex {
+    int numTris;        // number of distinct trigrams
+    uint32_t *tris;     // the trigrams, sorted
+    int *postOff;       // start of the trigram's posting list
+    int *posts;         // the posting lists, back to back
+} RtTriIndex;
+
+// Numeric columns with a range index
+typedef enum RtRngFld {
+    rrgDistance = 0,
+    rrgDuration = 1,
+    rrgElevation = 2,
+    rrgNum = 3,
+} RtRngFld;
+
+// Fields with a normalized copy, which are searched by the
+// match filters
+typedef enum RtNormFld {
+    rnfCategories = 0,
+    rnfContributor = 1,
+    rnfLocation = 2,
+    rnfShiz = 3,
+    rnfTitle = 4,
+    rnfVim1080 = 5,
+    rnfNum = 6,
+} RtNormFld;
+
+// Buffer the normalized copies of a range of routes are
+// stored into, as they are made
+typedef struct RtNormBuf {
+    char *ptr;      // where the next copy goes
+} RtNormBuf;
+
+// Range index of a numeric column: the values of the column
+// sorted in ascending order, with the route of each value;
+// so the routes with a value in a given range are a slice
+// of the index, which is found with two binary searches.
+typedef struct RtRangeIdx {
+    float *vals;        // the sorted values
+    int *ids;           // the route of each value
+} RtRangeIdx;
+
+// Hash index of the route IDs: an open-addressing table with
+// linear probing, which holds the index of the route with each
+// ID. The table is at most half full, so the probe sequences
+// are short.
+typedef struct RtIdHash {
+    int size;           // number of slots (a power of 2)
+    int *slots;         // route index, or -1 if the slot is free
+} RtIdHash;
+
 typedef struct RouteDB {
+    // Memory arena of the route records, the columns,
+    // and the strings owned by the DB.
+    RtArena arena;
+
+    // Snapshot file the DB was loaded from, which stays
+    // mapped for as long as the DB is in use.
+    void *mapAddr;
+    size_t mapLen;
+
     // URL prefix for fetching the MP4 file of a route
     char *mp4UrlPfx;
 
     // URL prefix for fetching the SHIZ file of a route
     char *shizUrlPfx;
 
-    // List of routes
+    // All the routes in the library. The string fields are
+    // kept in the route records, while the numeric fields are
+    // parsed once, when the route is added, into columns that
+    // are indexed by the route's index; so filtering or sorting
+    // the routes by them only needs to scan a plain array.
+    int numRecs;
+    RouteInfo *routes;
+    float *distance;        // distance (in km)
+    float *elevation;       // elevation gain (in meters)
+    int *toughness;         // toughness score
+    int *duration;          // duration of the video (in seconds)
+    int64_t *updated;       // last update time (in ms since the Epoch)
+    int *views;             // number of views
+    uint64_t *hash;         // hash of the route's contents, if built
+
+    // Inverted indexes, if they have been built
+    int indexed;
+    RtIndex index[rifNum];
+    RtTriIndex triIndex[rtrNum];
+    RtRangeIdx rangeIndex[rrgNum];
+
+    // Hash index of the route IDs, if it has been built
+    RtIdHash idHash;
+
+    // List of selected routes
     TAILQ_HEAD(RouteList, RouteInfo) routeList;
 
     // Number of routes in the list
     int numRoutes;
+
+    // Previous version of the DB, whose selected routes are
+    // the ones that have been removed since then, if any
+    struct RouteDB *removedDb;
 } RouteDB;
 
 extern int rtDbInit(RouteDB *rtDb);
-extern int rtDbAdd(RouteDB *rtDb, const RouteInfo *rtInfo);
+
+// Release all the memory owned by the DB, and leave it
+// empty, ready to be reused.
+extern void rtDbFree(RouteDB *rtDb);
+
+// Allocate a chunk of memory from the arena of the DB. The
+// memory is zeroed, and it is released by rtDbFree().
+extern void *rtDbMalloc(RouteDB *rtDb, size_t size);
+
+// Copy the string into the arena of the DB, adding the
+// terminating NUL character.
+extern char *rtDbStrDup(RouteDB *rtDb, const char *str, size_t len);
+
+// Allocate the route records and the columns of the DB
+// for the specified number of routes.
+extern int rtDbAlloc(RouteDB *rtDb, int numRecs);
+
+// Extract the fields of the route from its JSON object, and
+// store them in the specified entry of the DB. The route
+// object is walked once, and each member is dispatched to
+// its RouteInfo field via a perfect hash of its key path.
+// Different threads can parse different entries at the same
+// time.
+extern int rtDbParseRoute(RouteDB *rtDb, int index, const JsonObject *pObj);
+
+// The two steps of rtDbParseRoute(), which can be run apart
+// so that a filtered ingest only parses the values checked by
+// the filters until the route has passed them: extract the
+// views of the fields, and check the required ones are there;
+// then parse the numeric columns, or just one of them.
+extern int rtDbExtractRoute(RouteDB *rtDb, int index, const JsonObject *pObj);
+extern void rtDbParseCols(RouteDB *rtDb, int index);
+extern void rtDbParseCol(RouteDB *rtDb, int index, RtRngFld fld);
+
+// Store the normalized copies of the fields searched by the
+// match filters of the routes [first, first+count), once they
+// have been parsed. Different threads can normalize different
+// ranges of routes at the same time.
+extern int rtDbNormRoutes(RouteDB *rtDb, int first, int count);
+
+// The steps of rtDbNormRoutes(), which can be run on demand:
+// allocate the buffer for the normalized copies of the routes
+// [first, first+count); then normalize one field of a route
+// from that range, unless done already, and get the copy; or
+// all the fields of the route not normalized yet.
+extern int rtDbNormBufAlloc(RouteDB *rtDb, int first, int count, RtNormBuf *pBuf);
+extern const JsonStrView *rtDbNormField(RtNormBuf *pBuf, RouteInfo *pInfo, RtNormFld fld);
+extern void rtDbNormRoute(RtNormBuf *pBuf, RouteInfo *pInfo);
+
+// Get the normalized copy of the field of the route
+extern const JsonStrView *rtDbNormView(const RouteInfo *pInfo, RtNormFld fld);
+
+// Build the inverted indexes of the DB
+extern int rtDbBuildIndexes(RouteDB *rtDb);
+
+// Get the normalized value of the indexed field of the route
+extern const JsonStrView *rtDbIdxField(const RouteInfo *pInfo, RtIdxFld fld);
+
+// Look up the routes whose indexed field contains the query
+// string, which must be normalized, using the same liberal
+// match as the filters. The query is matched against
+// the distinct values of the field, and the posting lists of
+// the values that match are merged into a sorted list of the
+// route indexes, which is returned in *pList and must be freed
+// by the caller. Returns the number of routes, or -1 on error.
+extern int rtDbIdxLookup(const RouteDB *rtDb, RtIdxFld fld, const char *query, int **pList);
+
+// Get the normalized value of the trigram-indexed field of
+// the route
+extern const JsonStrView *rtDbTriField(const RouteInfo *pInfo, RtTriFld fld);
+
+// Look up the routes whose trigram-indexed field may contain
+// the query string, which must be normalized: i.e. those that
+// have all the trigrams of the query. The candidates, which
+// still have to be checked, are returned as a sorted list in
+// *pList, which must be freed by the caller. Returns the number
+// of candidates, or -1 on error. Queries shorter than 3 bytes
+// have no trigrams, in which case *pList is set to NULL.
+extern int rtDbTriLookup(const RouteDB *rtDb, RtTriFld fld, const char *query, int **pList);
+
+// Look up the routes whose value of the numeric column is in
+// the range [min, max]. The slice of the index with the routes
+// is returned in *pIds, in ascending order of the values, and
+// it's owned by the DB. Returns the number of routes.
+extern int rtDbRangeLookup(const RouteDB *rtDb, RtRngFld fld, double min, double max, const int **pIds);
+
+// Compute the hash of the decoded contents of each route, which
+// tells whether a route has changed between two versions of
+// the library. The number of views isn't part of the hash,
+// as it changes all the time. The hashes are also computed
+// by rtDbBuildIndexes(), along with the indexes.
+extern int rtDbHashRoutes(RouteDB *rtDb);
+
+// Build the hash index of the route IDs. It's also built by
+// rtDbBuildIndexes(), along with the other indexes.
+extern int rtDbBuildIdHash(RouteDB *rtDb);
+
+// Look up the route with the specified ID (i.e. its "_id"
+// value) using the hash index of the IDs. Returns the index
+// of the route, or -1 if there's no such route.
+extern int rtDbIdLookup(const RouteDB *rtDb, const char *id, size_t len);
+
+// Add the specified route to the list of selected routes
+extern void rtDbSelect(RouteDB *rtDb, int index);
+
+// Empty the list of selected routes
+extern void rtDbDeselectAll(RouteDB *rtDb);
 
 __END_DECLS
@@ -0,0 +1,323 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "args.h"
+#include "server.h"
+
+#if (OS_TYPE == OS_TYPE_LINUX)
+
+#include <libgen.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Max length of a request, including the newline
+#define SRV_MAX_REQ     4096
+
+// Max number of events handled per epoll_wait() call
+#define SRV_MAX_EVENTS  64
+
+// Type of the file descriptors in the epoll set
+typedef enum SrvFdTyp {
+    sftListen = 1,  // listening socket
+    sftWatch = 2,   // inotify instance
+    sftSignal = 3,  // signalfd of SIGINT and SIGTERM
+    sftConn = 4,    // client connection
+} SrvFdTyp;
+
+typedef struct SrvConn {
+    SrvFdTyp type;
+    int fd;
+    char req[SRV_MAX_REQ];  // request received so far
+    size_t reqLen;
+    char *resp;             // response to send
+    size_t respLen;
+    size_t respOff;         // amount of the response sent so far
+} SrvConn;
+
+typedef struct SrvCtx {
+    int epFd;
+    const char *watchName;  // name of the watched file in its folder
+    SrvReqHandler reqHandler;
+    SrvReloadHandler reloadHandler;
+    void *arg;
+} SrvCtx;
+
+static void srvClose(SrvCtx *pCtx, SrvConn *pConn)
+{
+    epoll_ctl(pCtx->epFd, EPOLL_CTL_DEL, pConn->fd, NULL);
+    close(pConn->fd);
+    free(pConn->resp);
+    free(pConn);
+}
+
+static int srvAdd(SrvCtx *pCtx, SrvConn *pConn, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = pConn };
+
+    return epoll_ctl(pCtx->epFd, EPOLL_CTL_ADD, pConn->fd, &ev);
+}
+
+// Accept all the pending connections
+static void srvAccept(SrvCtx *pCtx, SrvConn *pListen)
+{
+    int fd;
+
+    while ((fd = accept4(pListen->fd, NULL, NULL, (SOCK_NONBLOCK | SOCK_CLOEXEC))) >= 0) {
+        SrvConn *pConn;
+
+        if ((pConn = calloc(1, sizeof (SrvConn))) == NULL) {
+            close(fd);
+            continue;
+        }
+        pConn->type = sftConn;
+        pConn->fd = fd;
+
+        if (srvAdd(pCtx, pConn, EPOLLIN) != 0) {
+            close(fd);
+            free(pConn);
+        }
+    }
+}
+
+// Send as much of the response as the socket takes. Returns
+// 1 when the response has been sent, 0 if the rest has to
+// wait until the socket is writable, or -1 on error.
+static int srvSend(SrvConn *pConn)
+{
+    while (pConn->respOff < pConn->respLen) {
+        ssize_t len = send(pConn->fd, (pConn->resp + pConn->respOff), (pConn->respLen - pConn->respOff), MSG_NOSIGNAL);
+        if (len < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+        pConn->respOff += len;
+    }
+
+    return 1;
+}
+
+// Handle the request, and start sending the response
+static void srvHandleReq(SrvCtx *pCtx, SrvConn *pConn)
+{
+    FILE *fp;
+    int s;
+
+    if ((fp = open_memstream(&pConn->resp, &pConn->respLen)) == NULL) {
+        srvClose(pCtx, pConn);
+        return;
+    }
+
+    if (pConn->reqLen == sizeof (pConn->req)) {
+        fprintf(fp, "ERROR: request too long!\n");
+    } else {
+        pConn->req[pConn->reqLen] = '\0';
+        pConn->req[strcspn(pConn->req, "\r\n")] = '\0';
+        pCtx->reqHandler(pConn->req, fp, pCtx->arg);
+    }
+
+    if (fclose(fp) != 0) {
+        srvClose(pCtx, pConn);
+        return;
+    }
+
+    // Only wait for the socket to become writable if the
+    // response doesn't fit in its send buffer.
+    if ((s = srvSend(pConn)) != 0) {
+        srvClose(pCtx, pConn);
+    } else {
+        struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = pConn };
+        if (epoll_ctl(pCtx->epFd, EPOLL_CTL_MOD, pConn->fd, &ev) != 0)
+            srvClose(pCtx, pConn);
+    }
+}
+
+// Read the request, until the newline, or the end of the
+// stream. Once the request buffer is full, the rest of the
+// request is read and discarded, so that the error response
+// isn't lost to the reset caused by closing the connection
+// with unread data.
+static void srvRecv(SrvCtx *pCtx, SrvConn *pConn)
+{
+    while (1) {
+        char discard[SRV_MAX_REQ];
+        int full = (pConn->reqLen >= (sizeof (pConn->req) - 1));
+        char *buf = full ? discard : (pConn->req + pConn->reqLen);
+        size_t bufLen = full ? sizeof (discard) : (sizeof (pConn->req) - 1 - pConn->reqLen);
+        ssize_t len = recv(pConn->fd, buf, bufLen, 0);
+        if (len < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                srvClose(pCtx, pConn);
+            return;
+        } else if (len == 0) {
+            break;
+        }
+        if (!full)
+            pConn->reqLen += len;
+        if (memchr(buf, '\n', len) != NULL)
+            break;
+    }
+
+    if ((pConn->reqLen >= (sizeof (pConn->req) - 1)) && (memchr(pConn->req, '\n', (sizeof (pConn->req) - 1)) == NULL))
+        pConn->reqLen = sizeof (pConn->req);
+
+    srvHandleReq(pCtx, pConn);
+}
+
+// Check whether any of the inotify events is about the
+// watched file, which has been rewritten or replaced.
+static int srvWatchEvent(SrvCtx *pCtx, SrvConn *pWatch)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int changed = 0;
+
+    while ((len = read(pWatch->fd, buf, sizeof (buf))) > 0) {
+        for (char *p = buf; p < (buf + len); ) {
+            const struct inotify_event *pEv = (const struct inotify_event *) p;
+            if ((pEv->len != 0) && (strcmp(pEv->name, pCtx->watchName) == 0))
+                changed = 1;
+            p += sizeof (struct inotify_event) + pEv->len;
+        }
+    }
+
+    return changed;
+}
+
+int srvRun(const char *sockPath, const char *watchPath, SrvReqHandler reqHandler, SrvReloadHandler reloadHandler, void *arg)
+{
+    SrvCtx ctx = { .reqHandler = reqHandler, .reloadHandler = reloadHandler, .arg = arg };
+    SrvConn listenConn = { .type = sftListen, .fd = -1 };
+    SrvConn watchConn = { .type = sftWatch, .fd = -1 };
+    SrvConn sigConn = { .type = sftSignal, .fd = -1 };
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    char watchDir[1024], watchName[1024];
+    struct stat stBuf = {0};
+    sigset_t sigMask;
+    int s = -1;
+
+    if (strlen(sockPath) >= sizeof (addr.sun_path)) {
+        fprintf(stderr, "ERROR: socket path too long: %s\n", sockPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, sockPath);
+
+    // dirname() and basename() may modify their argument
+    snprintf(watchDir, sizeof (watchDir), "%s", watchPath);
+    snprintf(watchName, sizeof (watchName), "%s", watchPath);
+    ctx.watchName = basename(watchName);
+
+    // Handle SIGINT and SIGTERM in the event loop, so the
+    // socket file can be removed on the way out.
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGINT);
+    sigaddset(&sigMask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigMask, NULL);
+
+    if ((ctx.epFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        fprintf(stderr, "ERROR: can't create epoll instance (%s)\n", strerror(errno));
+        return -1;
+    }
+
+    // A stale socket file from a previous run would make
+    // the bind() fail.
+    if ((stat(sockPath, &stBuf) == 0) && S_ISSOCK(stBuf.st_mode))
+        unlink(sockPath);
+
+    if (((listenConn.fd = socket(AF_UNIX, (SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC), 0)) < 0) ||
+        (bind(listenConn.fd, (struct sockaddr *) &addr, sizeof (addr)) != 0) ||
+        (listen(listenConn.fd, SOMAXCONN) != 0) ||
+        (srvAdd(&ctx, &listenConn, EPOLLIN) != 0)) {
+        fprintf(stderr, "ERROR: can't listen on socket \"%s\" (%s)\n", sockPath, strerror(errno));
+        goto done;
+    }
+
+    // The folder of the file is watched, rather than the
+    // file itself, so that replacing the file by renaming
+    // a new one over it is also noticed.
+    if (((watchConn.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) ||
+        (inotify_add_watch(watchConn.fd, dirname(watchDir), (IN_CLOSE_WRITE | IN_MOVED_TO)) < 0) ||
+        (srvAdd(&ctx, &watchConn, EPOLLIN) != 0)) {
+        fprintf(stderr, "ERROR: can't watch file \"%s\" (%s)\n", watchPath, strerror(errno));
+        goto done;
+    }
+
+    if (((sigConn.fd = signalfd(-1, &sigMask, (SFD_NONBLOCK | SFD_CLOEXEC))) < 0) ||
+        (srvAdd(&ctx, &sigConn, EPOLLIN) != 0)) {
+        fprintf(stderr, "ERROR: can't create signalfd (%s)\n", strerror(errno));
+        goto done;
+    }
+
+    while (1) {
+        struct epoll_event events[SRV_MAX_EVENTS];
+        int numEvents;
+
+        if ((numEvents = epoll_wait(ctx.epFd, events, SRV_MAX_EVENTS, -1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "ERROR: epoll_wait() failed (%s)\n", strerror(errno));
+            goto done;
+        }
+
+        // Handle the change of the watched file first, so
+        // the requests in this batch see the new contents.
+        for (int n = 0; n < numEvents; n++) {
+            SrvConn *pConn = events[n].data.ptr;
+            if ((pConn->type == sftWatch) && srvWatchEvent(&ctx, pConn)) {
+                if (ctx.reloadHandler(ctx.arg) != 0)
+                    fprintf(stderr, "WARNING: can't reload file \"%s\"\n", watchPath);
+            } else if (pConn->type == sftSignal) {
+                s = 0;
+                goto done;
+            }
+        }
+
+        for (int n = 0; n < numEvents; n++) {
+            SrvConn *pConn = events[n].data.ptr;
+            if (pConn->type == sftListen) {
+                srvAccept(&ctx, pConn);
+            } else if (pConn->type == sftConn) {
+                if (events[n].events & (EPOLLERR | EPOLLHUP)) {
+                    srvClose(&ctx, pConn);
+                } else if (events[n].events & EPOLLOUT) {
+                    if (srvSend(pConn) != 0)
+                        srvClose(&ctx, pConn);
+                } else if (events[n].events & EPOLLIN) {
+                    srvRecv(&ctx, pConn);
+                }
+            }
+        }
+    }
+
+done:
+    // The connections that are still open are released
+    // when the process exits.
+    if (listenConn.fd >= 0) {
+        close(listenConn.fd);
+        unlink(sockPath);
+    }
+    if (watchConn.fd >= 0)
+        close(watchConn.fd);
+    if (sigConn.fd >= 0)
+        close(sigConn.fd);
+    close(ctx.epFd);
+    sigprocmask(SIG_UNBLOCK, &sigMask, NULL);
+
+    return s;
+}
+
+#else
+
+int srvRun(const char *sockPath, const char *watchPath, SrvReqHandler reqHandler, SrvReloadHandler reloadHandler, void *arg)
+{
+    fprintf(stderr, "ERROR: server mode is only supported on Linux\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdio.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Handler of a request. The request is a line of text, with
+// the trailing newline removed, and the handler writes the
+// response to the specified file; including the error message
+// if the request failed. Returns 0 on success, or -1 on error.
+typedef int (*SrvReqHandler)(char *req, FILE *fp, void *arg);
+
+// Handler of a change of the watched file
+typedef int (*SrvReloadHandler)(void *arg);
+
+// Serve the requests that arrive on the Unix domain socket
+// at the specified path, until SIGINT or SIGTERM is received.
+// Each connection carries a single request, and it's closed
+// once the response has been sent. The connections are
+// handled by a single thread with an epoll event loop, so the
+// handlers don't need any locking. When the watched file is
+// replaced or rewritten, the reload handler is called before
+// any further request is handled. Returns 0 on success, or
+// -1 on error.
+extern int srvRun(const char *sockPath, const char *watchPath, SrvReqHandler reqHandler, SrvReloadHandler reloadHandler, void *arg);
+
+__END_DECLS
@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -160,11 +161,68 @@ static int createGpxFile(const char *title, const char *shizPath, const GpsTrk *
     return 0;
 }
 
+// The members of the "trkpt" object that are stored in
+// the TrkPt; all of them are required.
+typedef struct TrkPtFld {
+    const char *key;    // member key; e.g. "-lon"
+    size_t keyLen;
+    const char *name;   // used in error messages
+    size_t offset;      // offset of the TrkPt member
+} TrkPtFld;
+
+#define TRKPT_FLD(key, name, member)    { key, (sizeof (key) - 1), name, offsetof(TrkPt, member) }
+
+static const TrkPtFld trkPtFields[] = {
+    TRKPT_FLD("-lon", "longitude", longitude),
+    TRKPT_FLD("-lat", "latitude", latitude),
+    TRKPT_FLD("speed", "speed", speed),
+    TRKPT_FLD("ele", "elevation", elevation),
+    TRKPT_FLD("distance", "distance", distance),
+    TRKPT_FLD("bearing", "bearing", bearing),
+    TRKPT_FLD("slope", "slope", grade),
+    TRKPT_FLD("time", "time", timestamp),
+};
+
+#define TRKPT_NUM_FIELDS    (sizeof (trkPtFields) / sizeof (trkPtFields[0]))
+
+typedef struct TrkPtCtx {
+    TrkPt *pTrkPt;
+    uint32_t found;     // bitmask of the fields found
+} TrkPtCtx;
+
+static int procTrkPtMember(const JsonMember *pMbr, void *arg)
+{
+    TrkPtCtx *pCtx = arg;
+
+    for (int n = 0; n < TRKPT_NUM_FIELDS; n++) {
+        const TrkPtFld *pFld = &trkPtFields[n];
+        void *pVal = (char *) pCtx->pTrkPt + pFld->offset;
+        int s;
+
+        if ((pFld->keyLen != pMbr->key.len) || (memcmp(pFld->key, pMbr->key.str, pFld->keyLen) != 0))
+            continue;
+
+        if (pFld->offset == offsetof(TrkPt, timestamp)) {
+            JsonStrView view;
+            s = ((jsonMemberStrView(pMbr, &view) == 0) && (jsonParseTime(view.str, view.len, pVal) == 0)) ? 0 : -1;
+        } else {
+            s = jsonMemberDoubleValue(pMbr, pVal);
+        }
+
+        if (s == 0)
+            pCtx->found |= (1U << n);
+
+        break;
+    }
+
+    return 0;
+}
+
 static int procTrkPtObj(const JsonObject *pObj, void *arg)
 {
     GpsTrk *pTrk = arg;
     TrkPt *pTrkPt;
-    time_t time;
+    TrkPtCtx ctx;
 
     //printf("trkpt: %s\n", fmtTrkPtObj(pObj));
 
@@ -183,54 +241,20 @@ static int procTrkPtObj(const JsonObject *pObj, void *arg)
     // In some shiz files the numeric values are not strings but actual
     // integer/float numbers, so we allow for either format...
 
-    if ((jsonGetStrDoubleValue(pObj, "-lon", &pTrkPt->longitude) != 0) &&
-        (jsonGetDoubleValue(pObj, "-lon", &pTrkPt->longitude) != 0)) {
-        fprintf(stderr, "ERROR: Can't get longitude value: %s\n", fmtTrkPtObj(pObj));
+    ctx.pTrkPt = pTrkPt;
+    ctx.found = 0;
+    if (jsonObjectForEachMember(pObj, procTrkPtMember, &ctx) != 0) {
+        fprintf(stderr, "ERROR: Malformed trkpt object: %s\n", fmtTrkPtObj(pObj));
         return -1;
     }
 
-    if ((jsonGetStrDoubleValue(pObj, "-lat", &pTrkPt->latitude) != 0) &&
-        (jsonGetDoubleValue(pObj, "-lat", &pTrkPt->latitude) != 0)) {
-        fprintf(stderr, "ERROR: Can't get latitude value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
-    }
-
-    if ((jsonGetStrDoubleValue(pObj, "speed", &pTrkPt->speed) != 0) &&
-        (jsonGetDoubleValue(pObj, "speed", &pTrkPt->speed) != 0)) {
-        fprintf(stderr, "ERROR: Can't get speed value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
+    for (int n = 0; n < TRKPT_NUM_FIELDS; n++) {
+        if (!(ctx.found & (1U << n))) {
+            fprintf(stderr, "ERROR: Can't get %s value: %s\n", trkPtFields[n].name, fmtTrkPtObj(pObj));
+            return -1;
+        }
     }
 
-    if ((jsonGetStrDoubleValue(pObj, "ele", &pTrkPt->elevation) != 0) &&
-        (jsonGetDoubleValue(pObj, "ele", &pTrkPt->elevation) != 0)) {
-        fprintf(stderr, "ERROR: Can't get elevation value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
-    }
-
-    if ((jsonGetStrDoubleValue(pObj, "distance", &pTrkPt->distance) != 0) &&
-        (jsonGetDoubleValue(pObj, "distance", &pTrkPt->distance) != 0)) {
-        fprintf(stderr, "ERROR: Can't get distance value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
-    }
-
-    if ((jsonGetStrDoubleValue(pObj, "bearing", &pTrkPt->bearing) != 0) &&
-        (jsonGetDoubleValue(pObj, "bearing", &pTrkPt->bearing) != 0)) {
-        fprintf(stderr, "ERROR: Can't get bearing value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
-    }
-
-    if ((jsonGetStrDoubleValue(pObj, "slope", &pTrkPt->grade) != 0) &&
-        (jsonGetDoubleValue(pObj, "slope", &pTrkPt->grade) != 0)) {
-        fprintf(stderr, "ERROR: Can't get slope value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
-    }
-
-    if (jsonGetStrTimeValue(pObj, "time", &time) != 0) {
-        fprintf(stderr, "ERROR: Can't get time value: %s\n", fmtTrkPtObj(pObj));
-        return -1;
-    }
-
-    pTrkPt->timestamp = time;
     pTrkPt->distance *= 1000.0; // convert from km to m
     pTrkPt->speed *= 0.277778;  // convert from km/h to m/s
 
@@ -285,6 +309,7 @@ static GpsTrk *parseShizFile(const char *filePath)
 {
     InFile inFile = { .filePath = filePath };
     GpsTrk *pTrk = NULL;
+    JsonTape tape = {0};
     JsonObject mainObj = {0};
     JsonObject trkpt = {0};
 
@@ -300,19 +325,28 @@ static GpsTrk *parseShizFile(const char *filePath)
     //    return NULL;
     //}
 
-    mainObj.start = inFile.data;
-    mainObj.end = mainObj.start + inFile.dataLen - 1;
+    // Tokenize the file into a tape, so that the lookups
+    // of the values of each "trkpt" object are resolved
+    // without rescanning the text.
+    if ((jsonTapeBuild(inFile.data, inFile.dataLen, &tape) != 0) ||
+        (jsonTapeGetRoot(&tape, &mainObj) != 0)) {
+        mainObj.start = inFile.data;
+        mainObj.end = mainObj.start + inFile.dataLen - 1;
+        mainObj.tape = NULL;
+    }
 
     // Get the "trkpt" array which contains all
     // the trackpoint objects.
     if (jsonFindArrayByTag(&mainObj, "trkpt", &trkpt) != 0) {
         fprintf(stderr, "ERROR: can't find \"trkpt\" array object!\n");
+        jsonTapeFree(&tape);
         free(inFile.data);
         return NULL;
     }
 
     if ((pTrk = gpsTrkNew()) == NULL) {
         fprintf(stderr, "ERROR: can't alloc GpsTrk object!\n");
+        jsonTapeFree(&tape);
         free(inFile.data);
         return NULL;
     }
@@ -323,6 +357,7 @@ static GpsTrk *parseShizFile(const char *filePath)
     jsonArrayForEach(&trkpt, procTrkPtObj, pTrk);
 
     // We don't need this anymore ...
+    jsonTapeFree(&tape);
     free(inFile.data);
 
     return pTrk;
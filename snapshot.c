@@ -0,0 +1,571 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "args.h"
+#include "snapshot.h"
+
+#if (OS_TYPE == OS_TYPE_MACOS)
+#undef st_mtim
+#define st_mtim st_mtimespec
+#endif
+
+/*
+ * A snapshot is a binary image of the route DB, which can be
+ * memory-mapped and used as-is, without having to parse the
+ * allrides file again. It has the following layout, with all
+ * the sections aligned to 8 bytes:
+ *
+ *   SnapHdr      header
+ *   SnapRec[]    route records
+ *   float[]      distance column
+ *   float[]      elevation column
+ *   int32_t[]    toughness column
+ *   int32_t[]    duration column
+ *   int64_t[]    updated column
+ *   int32_t[]    views column
+ *   SnapIdx      inverted indexes: value representatives,
+ *                posting list offsets, and posting lists
+ *   SnapTriIdx   trigram indexes: trigrams, posting list
+ *                offsets, and posting lists
+ *   SnapRngIdx   range indexes: sorted values, and route
+ *                indexes
+ *   int32_t[]    hash index of the route IDs
+ *   uint64_t[]   hashes of the contents of the routes
+ *   char[]       string pool
+ *
+ * The string fields of the route records are stored as the
+ * offset and length of the string in the pool, which holds
+ * the raw JSON text of the strings, just like the views of
+ * the RouteInfo records do, and the normalized copies of the
+ * fields searched by the filters. The columns and the indexes
+ * are used in place.
+ */
+
+#define SNAP_MAGIC      "WOFGSNAP"
+#define SNAP_VERSION    9
+#define SNAP_BYTE_ORDER 0x01020304
+#define SNAP_ALIGN(n)   (((n) + 7) & ~((uint64_t) 7))
+
+// The string fields of the RouteInfo record
+static const size_t snapStrFields[] = {
+    offsetof(RouteInfo, categories),
+    offsetof(RouteInfo, contributor),
+    offsetof(RouteInfo, description),
+    offsetof(RouteInfo, distance),
+    offsetof(RouteInfo, duration),
+    offsetof(RouteInfo, elevation),
+    offsetof(RouteInfo, id),
+    offsetof(RouteInfo, location),
+    offsetof(RouteInfo, shiz),
+    offsetof(RouteInfo, title),
+    offsetof(RouteInfo, toughness),
+    offsetof(RouteInfo, vimMaster),
+    offsetof(RouteInfo, vim1080),
+    offsetof(RouteInfo, vim720),
+    offsetof(RouteInfo, updated),
+    offsetof(RouteInfo, views),
+    offsetof(RouteInfo, categoriesNorm),
+    offsetof(RouteInfo, contributorNorm),
+    offsetof(RouteInfo, locationNorm),
+    offsetof(RouteInfo, shizNorm),
+    offsetof(RouteInfo, titleNorm),
+    offsetof(RouteInfo, vim1080Norm),
+};
+
+#define SNAP_NUM_STRS   (sizeof (snapStrFields) / sizeof (snapStrFields[0]))
+
+_Static_assert((SNAP_NUM_STRS * sizeof (JsonStrView)) == (offsetof(RouteInfo, index) - offsetof(RouteInfo, categories)),
+               "A string field of RouteInfo is missing from the snapshot!");
+_Static_assert((sizeof (int) == sizeof (int32_t)), "The int columns are stored as int32_t!");
+
+typedef struct SnapStr {
+    uint32_t off;       // offset in the string pool
+    uint32_t len;       // length of the string
+} SnapStr;
+
+typedef struct SnapRec {
+    SnapStr strs[SNAP_NUM_STRS];
+} SnapRec;
+
+typedef struct SnapIdx {
+    uint32_t numVals;       // number of distinct values
+    uint32_t pad;
+    uint64_t repOff;
+    uint64_t postOffOff;
+    uint64_t postsOff;
+} SnapIdx;
+
+typedef struct SnapTriIdx {
+    uint32_t numTris;       // number of distinct trigrams
+    uint32_t numPosts;      // total length of the posting lists
+    uint64_t trisOff;
+    uint64_t postOffOff;
+    uint64_t postsOff;
+} SnapTriIdx;
+
+typedef struct SnapRngIdx {
+    uint64_t valsOff;
+    uint64_t idsOff;
+} SnapRngIdx;
+
+typedef struct SnapHdr {
+    char magic[8];          // SNAP_MAGIC
+    uint32_t version;       // SNAP_VERSION
+    uint32_t byteOrder;     // SNAP_BYTE_ORDER
+    uint32_t recSize;       // sizeof (SnapRec)
+    uint32_t numRecs;       // number of route records
+    uint64_t fileSize;      // size of the snapshot file
+
+    // Identity of the source file
+    uint64_t srcSize;
+    int64_t srcMtime;
+    uint64_t srcHash;
+
+    // Offsets of the sections
+    uint64_t recsOff;
+    uint64_t distanceOff;
+    uint64_t elevationOff;
+    uint64_t toughnessOff;
+    uint64_t durationOff;
+    uint64_t updatedOff;
+    uint64_t viewsOff;
+    uint32_t indexed;       // the indexes are present
+    uint32_t pad;
+    SnapIdx index[rifNum];
+    SnapTriIdx triIndex[rtrNum];
+    SnapRngIdx rangeIndex[rrgNum];
+    uint32_t idHashSize;    // number of slots of the ID hash
+    uint32_t pad2;
+    uint64_t idHashOff;
+    uint64_t hashOff;       // hashes of the routes
+    uint64_t poolOff;
+    uint64_t poolLen;
+
+    SnapStr mp4UrlPfx;
+} SnapHdr;
+
+int snapGetSrcInfo(const char *srcPath, SnapSrc *pSrc)
+{
+    struct stat stBuf = {0};
+
+    if (stat(srcPath, &stBuf) != 0)
+        return -1;
+
+    memset(pSrc, 0, sizeof (SnapSrc));
+    pSrc->size = stBuf.st_size;
+    pSrc->mtime = ((int64_t) stBuf.st_mtim.tv_sec * 1000000000) + stBuf.st_mtim.tv_nsec;
+
+    return 0;
+}
+
+// Simple multiply-xorshift hash that consumes 8 bytes at a
+// time; it only has to detect changes in the allrides file,
+// so it doesn't need to be of cryptographic quality.
+uint64_t snapHash(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ len;
+    uint64_t word;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+
+    word = 0;
+    memcpy(&word, p, len);
+    hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+// Check that the section of 'num' elements of the given size
+// is inside the file.
+static int snapChkSect(const SnapHdr *pHdr, uint64_t off, uint64_t num, size_t size)
+{
+    return ((off % 8) == 0) && (off <= pHdr->fileSize) && (num <= ((pHdr->fileSize - off) / size)) ? 0 : -1;
+}
+
+// Check the sections of the indexes. The contents of the
+// posting lists are checked when they are loaded.
+static int snapChkIdx(const SnapHdr *pHdr)
+{
+    for (int fld = 0; pHdr->indexed && (fld < rifNum); fld++) {
+        const SnapIdx *pIdx = &pHdr->index[fld];
+        if ((pIdx->numVals > pHdr->numRecs) ||
+            (snapChkSect(pHdr, pIdx->repOff, pIdx->numVals, sizeof (int32_t)) != 0) ||
+            (snapChkSect(pHdr, pIdx->postOffOff, (pIdx->numVals + 1), sizeof (int32_t)) != 0) ||
+            (snapChkSect(pHdr, pIdx->postsOff, pHdr->numRecs, sizeof (int32_t)) != 0)) {
+            return -1;
+        }
+    }
+
+    for (int fld = 0; pHdr->indexed && (fld < rtrNum); fld++) {
+        const SnapTriIdx *pIdx = &pHdr->triIndex[fld];
+        if ((snapChkSect(pHdr, pIdx->trisOff, pIdx->numTris, sizeof (uint32_t)) != 0) ||
+            (snapChkSect(pHdr, pIdx->postOffOff, ((uint64_t) pIdx->numTris + 1), sizeof (int32_t)) != 0) ||
+            (snapChkSect(pHdr, pIdx->postsOff, pIdx->numPosts, sizeof (int32_t)) != 0)) {
+            return -1;
+        }
+    }
+
+    for (int fld = 0; pHdr->indexed && (fld < rrgNum); fld++) {
+        const SnapRngIdx *pIdx = &pHdr->rangeIndex[fld];
+        if ((snapChkSect(pHdr, pIdx->valsOff, pHdr->numRecs, sizeof (float)) != 0) ||
+            (snapChkSect(pHdr, pIdx->idsOff, pHdr->numRecs, sizeof (int32_t)) != 0)) {
+            return -1;
+        }
+    }
+
+    if (pHdr->indexed &&
+        ((pHdr->idHashSize == 0) || ((pHdr->idHashSize & (pHdr->idHashSize - 1)) != 0) ||
+         (snapChkSect(pHdr, pHdr->idHashOff, pHdr->idHashSize, sizeof (int32_t)) != 0) ||
+         (snapChkSect(pHdr, pHdr->hashOff, pHdr->numRecs, sizeof (uint64_t)) != 0))) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int snapLoad(RouteDB *rtDb, const char *snapPath, const SnapSrc *pSrc)
+{
+    struct stat stBuf = {0};
+    const SnapHdr *pHdr;
+    const SnapRec *recs;
+    const char *pool;
+    void *addr;
+    int fd;
+
+    if ((fd = open(snapPath, O_RDONLY, 0)) < 0)
+        return -1;
+
+    if ((fstat(fd, &stBuf) != 0) || (stBuf.st_size < sizeof (SnapHdr))) {
+        close(fd);
+        return -1;
+    }
+
+    // The mapping is private and writable, so the columns
+    // can be used as regular (copy-on-write) arrays.
+    addr = mmap(NULL, stBuf.st_size, (PROT_READ | PROT_WRITE), MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return -1;
+
+    rtDb->mapAddr = addr;
+    rtDb->mapLen = stBuf.st_size;
+
+    pHdr = addr;
+
+    if ((memcmp(pHdr->magic, SNAP_MAGIC, sizeof (pHdr->magic)) != 0) ||
+        (pHdr->version != SNAP_VERSION) ||
+        (pHdr->byteOrder != SNAP_BYTE_ORDER) ||
+        (pHdr->recSize != sizeof (SnapRec)) ||
+        (pHdr->fileSize != stBuf.st_size)) {
+        // Not a snapshot, or one from another version
+        goto invalid;
+    }
+
+    if ((pSrc != NULL) &&
+        ((pHdr->srcSize != pSrc->size) ||
+         ((pHdr->srcMtime != pSrc->mtime) && (!pSrc->hashValid || (pHdr->srcHash != pSrc->hash))))) {
+        // The source file has changed
+        goto invalid;
+    }
+
+    if ((snapChkSect(pHdr, pHdr->recsOff, pHdr->numRecs, sizeof (SnapRec)) != 0) ||
+        (snapChkSect(pHdr, pHdr->distanceOff, pHdr->numRecs, sizeof (float)) != 0) ||
+        (snapChkSect(pHdr, pHdr->elevationOff, pHdr->numRecs, sizeof (float)) != 0) ||
+        (snapChkSect(pHdr, pHdr->toughnessOff, pHdr->numRecs, sizeof (int32_t)) != 0) ||
+        (snapChkSect(pHdr, pHdr->durationOff, pHdr->numRecs, sizeof (int32_t)) != 0) ||
+        (snapChkSect(pHdr, pHdr->updatedOff, pHdr->numRecs, sizeof (int64_t)) != 0) ||
+        (snapChkSect(pHdr, pHdr->viewsOff, pHdr->numRecs, sizeof (int32_t)) != 0) ||
+        (snapChkIdx(pHdr) != 0) ||
+        (snapChkSect(pHdr, pHdr->poolOff, pHdr->poolLen, 1) != 0) ||
+        (pHdr->mp4UrlPfx.len > pHdr->poolLen) || (pHdr->mp4UrlPfx.off > (pHdr->poolLen - pHdr->mp4UrlPfx.len))) {
+        goto invalid;
+    }
+
+    recs = (const SnapRec *) ((const char *) addr + pHdr->recsOff);
+    pool = (const char *) addr + pHdr->poolOff;
+
+    if (((rtDb->routes = rtDbMalloc(rtDb, (pHdr->numRecs + 1) * sizeof (RouteInfo))) == NULL) ||
+        ((rtDb->mp4UrlPfx = rtDbStrDup(rtDb, (pool + pHdr->mp4UrlPfx.off), pHdr->mp4UrlPfx.len)) == NULL)) {
+        goto invalid;
+    }
+
+    for (uint32_t n = 0; n < pHdr->numRecs; n++) {
+        RouteInfo *pInfo = &rtDb->routes[n];
+
+        for (int s = 0; s < SNAP_NUM_STRS; s++) {
+            const SnapStr *pStr = &recs[n].strs[s];
+            JsonStrView *pView = (JsonStrView *) ((char *) pInfo + snapStrFields[s]);
+
+            if ((pStr->len > pHdr->poolLen) || (pStr->off > (pHdr->poolLen - pStr->len)))
+                goto invalid;
+
+            // An empty string is a missing field
+            if (pStr->len != 0) {
+                pView->str = pool + pStr->off;
+                pView->len = pStr->len;
+            }
+        }
+
+        pInfo->index = n;
+    }
+
+    rtDb->numRecs = pHdr->numRecs;
+    rtDb->distance = (float *) ((char *) addr + pHdr->distanceOff);
+    rtDb->elevation = (float *) ((char *) addr + pHdr->elevationOff);
+    rtDb->toughness = (int *) ((char *) addr + pHdr->toughnessOff);
+    rtDb->duration = (int *) ((char *) addr + pHdr->durationOff);
+    rtDb->updated = (int64_t *) ((char *) addr + pHdr->updatedOff);
+    rtDb->views = (int *) ((char *) addr + pHdr->viewsOff);
+
+    for (int fld = 0; pHdr->indexed && (fld < rifNum); fld++) {
+        const SnapIdx *pSnapIdx = &pHdr->index[fld];
+        RtIndex *pIdx = &rtDb->index[fld];
+
+        pIdx->numVals = pSnapIdx->numVals;
+        pIdx->rep = (int *) ((char *) addr + pSnapIdx->repOff);
+        pIdx->postOff = (int *) ((char *) addr + pSnapIdx->postOffOff);
+        pIdx->posts = (int *) ((char *) addr + pSnapIdx->postsOff);
+
+        // Make sure the lookups stay within the DB
+        if ((pIdx->postOff[0] != 0) || (pIdx->postOff[pIdx->numVals] != pHdr->numRecs))
+            goto invalid;
+        for (int v = 0; v < pIdx->numVals; v++) {
+            if ((pIdx->rep[v] < 0) || (pIdx->rep[v] >= pHdr->numRecs) || (pIdx->postOff[v] > pIdx->postOff[v + 1]))
+                goto invalid;
+        }
+        for (uint32_t n = 0; n < pHdr->numRecs; n++) {
+            if ((pIdx->posts[n] < 0) || (pIdx->posts[n] >= pHdr->numRecs))
+                goto invalid;
+        }
+    }
+    for (int fld = 0; pHdr->indexed && (fld < rtrNum); fld++) {
+        const SnapTriIdx *pSnapIdx = &pHdr->triIndex[fld];
+        RtTriIndex *pIdx = &rtDb->triIndex[fld];
+
+        pIdx->numTris = pSnapIdx->numTris;
+        pIdx->tris = (uint32_t *) ((char *) addr + pSnapIdx->trisOff);
+        pIdx->postOff = (int *) ((char *) addr + pSnapIdx->postOffOff);
+        pIdx->posts = (int *) ((char *) addr + pSnapIdx->postsOff);
+
+        // The posting lists are much longer than the other
+        // sections, so their route indexes are only checked
+        // by rtDbTriLookup(), for the lists it uses.
+        if ((pIdx->postOff[0] != 0) || (pIdx->postOff[pIdx->numTris] != pSnapIdx->numPosts))
+            goto invalid;
+        for (int t = 0; t < pIdx->numTris; t++) {
+            if (pIdx->postOff[t] > pIdx->postOff[t + 1])
+                goto invalid;
+        }
+    }
+    for (int fld = 0; pHdr->indexed && (fld < rrgNum); fld++) {
+        const SnapRngIdx *pSnapIdx = &pHdr->rangeIndex[fld];
+        RtRangeIdx *pIdx = &rtDb->rangeIndex[fld];
+
+        // The route indexes are checked by the caller
+        // of rtDbRangeLookup(), as it uses them.
+        pIdx->vals = (float *) ((char *) addr + pSnapIdx->valsOff);
+        pIdx->ids = (int *) ((char *) addr + pSnapIdx->idsOff);
+    }
+    if (pHdr->indexed) {
+        // The route indexes and the probe sequences are
+        // checked by rtDbIdLookup().
+        rtDb->idHash.size = pHdr->idHashSize;
+        rtDb->idHash.slots = (int *) ((char *) addr + pHdr->idHashOff);
+        rtDb->hash = (uint64_t *) ((char *) addr + pHdr->hashOff);
+    }
+    rtDb->indexed = pHdr->indexed;
+
+    return 0;
+
+invalid:
+    rtDbFree(rtDb);
+    return -1;
+}
+
+// Write the data at the specified offset of the file, padding
+// the gap from the current position with zeros.
+static int snapWrite(FILE *fp, uint64_t off, const void *data, size_t len)
+{
+    long pos = ftell(fp);
+
+    while ((pos >= 0) && (pos < off)) {
+        if (fputc(0, fp) == EOF)
+            return -1;
+        pos++;
+    }
+
+    if (pos != off)
+        return -1;
+
+    return ((len == 0) || (fwrite(data, len, 1, fp) == 1)) ? 0 : -1;
+}
+
+int snapSave(const RouteDB *rtDb, const char *snapPath, const SnapSrc *pSrc)
+{
+    SnapHdr hdr = {0};
+    uint64_t off;
+    uint64_t poolLen = 0;
+    uint32_t num = rtDb->numRecs;
+    char tmpPath[1100];
+    FILE *fp;
+    int s = 0;
+
+    // Figure out the size of the string pool
+    poolLen = strlen(rtDb->mp4UrlPfx);
+    for (uint32_t n = 0; n < num; n++) {
+        const RouteInfo *pInfo = &rtDb->routes[n];
+        for (int i = 0; i < SNAP_NUM_STRS; i++) {
+            poolLen += ((const JsonStrView *) ((const char *) pInfo + snapStrFields[i]))->len;
+        }
+    }
+
+    if (poolLen > UINT32_MAX) {
+        fprintf(stderr, "ERROR: string pool too large for the snapshot!\n");
+        return -1;
+    }
+
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof (hdr.magic));
+    hdr.version = SNAP_VERSION;
+    hdr.byteOrder = SNAP_BYTE_ORDER;
+    hdr.recSize = sizeof (SnapRec);
+    hdr.numRecs = num;
+    hdr.srcSize = pSrc->size;
+    hdr.srcMtime = pSrc->mtime;
+    hdr.srcHash = pSrc->hash;
+
+    off = SNAP_ALIGN(sizeof (SnapHdr));
+    hdr.recsOff = off;          off = SNAP_ALIGN(off + (num * sizeof (SnapRec)));
+    hdr.distanceOff = off;      off = SNAP_ALIGN(off + (num * sizeof (float)));
+    hdr.elevationOff = off;     off = SNAP_ALIGN(off + (num * sizeof (float)));
+    hdr.toughnessOff = off;     off = SNAP_ALIGN(off + (num * sizeof (int32_t)));
+    hdr.durationOff = off;      off = SNAP_ALIGN(off + (num * sizeof (int32_t)));
+    hdr.updatedOff = off;       off = SNAP_ALIGN(off + (num * sizeof (int64_t)));
+    hdr.viewsOff = off;         off = SNAP_ALIGN(off + (num * sizeof (int32_t)));
+    hdr.indexed = rtDb->indexed;
+    for (int fld = 0; hdr.indexed && (fld < rifNum); fld++) {
+        SnapIdx *pIdx = &hdr.index[fld];
+        pIdx->numVals = rtDb->index[fld].numVals;
+        pIdx->repOff = off;     off = SNAP_ALIGN(off + (pIdx->numVals * sizeof (int32_t)));
+        pIdx->postOffOff = off; off = SNAP_ALIGN(off + ((pIdx->numVals + 1) * sizeof (int32_t)));
+        pIdx->postsOff = off;   off = SNAP_ALIGN(off + (num * sizeof (int32_t)));
+    }
+    for (int fld = 0; hdr.indexed && (fld < rtrNum); fld++) {
+        const RtTriIndex *pTriIdx = &rtDb->triIndex[fld];
+        SnapTriIdx *pIdx = &hdr.triIndex[fld];
+        pIdx->numTris = pTriIdx->numTris;
+        pIdx->numPosts = pTriIdx->postOff[pTriIdx->numTris];
+        pIdx->trisOff = off;    off = SNAP_ALIGN(off + (pIdx->numTris * sizeof (uint32_t)));
+        pIdx->postOffOff = off; off = SNAP_ALIGN(off + ((pIdx->numTris + 1) * sizeof (int32_t)));
+        pIdx->postsOff = off;   off = SNAP_ALIGN(off + (pIdx->numPosts * sizeof (int32_t)));
+    }
+    for (int fld = 0; hdr.indexed && (fld < rrgNum); fld++) {
+        SnapRngIdx *pIdx = &hdr.rangeIndex[fld];
+        pIdx->valsOff = off;    off = SNAP_ALIGN(off + (num * sizeof (float)));
+        pIdx->idsOff = off;     off = SNAP_ALIGN(off + (num * sizeof (int32_t)));
+    }
+    if (hdr.indexed) {
+        hdr.idHashSize = rtDb->idHash.size;
+        hdr.idHashOff = off;    off = SNAP_ALIGN(off + (hdr.idHashSize * sizeof (int32_t)));
+        hdr.hashOff = off;      off = SNAP_ALIGN(off + (num * sizeof (uint64_t)));
+    }
+    hdr.poolOff = off;
+    hdr.poolLen = poolLen;
+    hdr.fileSize = off + poolLen;
+    hdr.mp4UrlPfx.off = 0;
+    hdr.mp4UrlPfx.len = strlen(rtDb->mp4UrlPfx);
+
+    snprintf(tmpPath, sizeof (tmpPath), "%s.%d.tmp", snapPath, (int) getpid());
+
+    if ((fp = fopen(tmpPath, "wb")) == NULL) {
+        // Can't write to the folder of the allrides
+        // file, so just do without the snapshot.
+        return -1;
+    }
+
+    s |= snapWrite(fp, 0, &hdr, sizeof (hdr));
+
+    // The route records
+    s |= snapWrite(fp, hdr.recsOff, NULL, 0);
+    off = hdr.mp4UrlPfx.len;
+    for (uint32_t n = 0; (s == 0) && (n < num); n++) {
+        const RouteInfo *pInfo = &rtDb->routes[n];
+        SnapRec rec;
+
+        for (int i = 0; i < SNAP_NUM_STRS; i++) {
+            const JsonStrView *pView = (const JsonStrView *) ((const char *) pInfo + snapStrFields[i]);
+            rec.strs[i].off = off;
+            rec.strs[i].len = pView->len;
+            off += pView->len;
+        }
+
+        if (fwrite(&rec, sizeof (rec), 1, fp) != 1)
+            s = -1;
+    }
+
+    // The numeric columns
+    s |= snapWrite(fp, hdr.distanceOff, rtDb->distance, (num * sizeof (float)));
+    s |= snapWrite(fp, hdr.elevationOff, rtDb->elevation, (num * sizeof (float)));
+    s |= snapWrite(fp, hdr.toughnessOff, rtDb->toughness, (num * sizeof (int32_t)));
+    s |= snapWrite(fp, hdr.durationOff, rtDb->duration, (num * sizeof (int32_t)));
+    s |= snapWrite(fp, hdr.updatedOff, rtDb->updated, (num * sizeof (int64_t)));
+    s |= snapWrite(fp, hdr.viewsOff, rtDb->views, (num * sizeof (int32_t)));
+
+    // The indexes
+    for (int fld = 0; hdr.indexed && (fld < rifNum); fld++) {
+        const SnapIdx *pSnapIdx = &hdr.index[fld];
+        const RtIndex *pIdx = &rtDb->index[fld];
+        s |= snapWrite(fp, pSnapIdx->repOff, pIdx->rep, (pIdx->numVals * sizeof (int32_t)));
+        s |= snapWrite(fp, pSnapIdx->postOffOff, pIdx->postOff, ((pIdx->numVals + 1) * sizeof (int32_t)));
+        s |= snapWrite(fp, pSnapIdx->postsOff, pIdx->posts, (num * sizeof (int32_t)));
+    }
+    for (int fld = 0; hdr.indexed && (fld < rtrNum); fld++) {
+        const SnapTriIdx *pSnapIdx = &hdr.triIndex[fld];
+        const RtTriIndex *pIdx = &rtDb->triIndex[fld];
+        s |= snapWrite(fp, pSnapIdx->trisOff, pIdx->tris, (pIdx->numTris * sizeof (uint32_t)));
+        s |= snapWrite(fp, pSnapIdx->postOffOff, pIdx->postOff, ((pIdx->numTris + 1) * sizeof (int32_t)));
+        s |= snapWrite(fp, pSnapIdx->postsOff, pIdx->posts, (pSnapIdx->numPosts * sizeof (int32_t)));
+    }
+    for (int fld = 0; hdr.indexed && (fld < rrgNum); fld++) {
+        const SnapRngIdx *pSnapIdx = &hdr.rangeIndex[fld];
+        const RtRangeIdx *pIdx = &rtDb->rangeIndex[fld];
+        s |= snapWrite(fp, pSnapIdx->valsOff, pIdx->vals, (num * sizeof (float)));
+        s |= snapWrite(fp, pSnapIdx->idsOff, pIdx->ids, (num * sizeof (int32_t)));
+    }
+    if (hdr.indexed) {
+        s |= snapWrite(fp, hdr.idHashOff, rtDb->idHash.slots, (hdr.idHashSize * sizeof (int32_t)));
+        s |= snapWrite(fp, hdr.hashOff, rtDb->hash, (num * sizeof (uint64_t)));
+    }
+
+    // The string pool, in the same order as the offsets
+    // were assigned above.
+    s |= snapWrite(fp, hdr.poolOff, rtDb->mp4UrlPfx, hdr.mp4UrlPfx.len);
+    for (uint32_t n = 0; (s == 0) && (n < num); n++) {
+        const RouteInfo *pInfo = &rtDb->routes[n];
+        for (int i = 0; i < SNAP_NUM_STRS; i++) {
+            const JsonStrView *pView = (const JsonStrView *) ((const char *) pInfo + snapStrFields[i]);
+            if ((pView->len != 0) && (fwrite(pView->str, pView->len, 1, fp) != 1))
+                s = -1;
+        }
+    }
+
+    if ((fclose(fp) != 0) || (s != 0) || (rename(tmpPath, snapPath) != 0)) {
+        fprintf(stderr, "WARNING: can't save snapshot file \"%s\" (%s)\n", snapPath, strerror(errno));
+        unlink(tmpPath);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <inttypes.h>
+#include <sys/cdefs.h>
+
+#include "routedb.h"
+
+__BEGIN_DECLS
+
+// Identity of the allrides file a snapshot was created from
+typedef struct SnapSrc {
+    uint64_t size;      // file size (in bytes)
+    int64_t mtime;      // modification time (in ns since the Epoch)
+    uint64_t hash;      // hash of the file's contents
+    int hashValid;      // the hash has been computed
+} SnapSrc;
+
+// Get the size and modification time of the source file
+extern int snapGetSrcInfo(const char *srcPath, SnapSrc *pSrc);
+
+// Compute the hash of the contents of the source file
+extern uint64_t snapHash(const void *data, size_t len);
+
+// Load the route DB from the snapshot file, if it's still
+// valid for the source file: i.e. the size and modification
+// time of the file match, or the size and the hash of the
+// contents match (if the hash is available). The snapshot
+// is memory-mapped, and the DB refers to it, so it stays
+// mapped until rtDbFree() is called. If 'pSrc' is NULL, the
+// snapshot is loaded whatever the state of the source file.
+extern int snapLoad(RouteDB *rtDb, const char *snapPath, const SnapSrc *pSrc);
+
+// Save the route DB to the snapshot file. The file is first
+// written to a temporary file, which is then renamed, so a
+// concurrent reader never sees a partial snapshot.
+extern int snapSave(const RouteDB *rtDb, const char *snapPath, const SnapSrc *pSrc);
+
+__END_DECLS
@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "sort.h"
+
+/*
+ * The routes are sorted with a LSD (least significant key
+ * first) scheme: the permutation is sorted by each key in
+ * turn, from the last one to the first one, with a stable
+ * sort, so the routes that are equal on a key keep the order
+ * given by the keys that follow it.
+ *
+ * Each key is first normalized into a 64-bit integer that
+ * sorts in the same order as the key: the numeric keys map
+ * to it exactly, and the string keys map their first 8 case-
+ * folded bytes to it. The entries are then sorted by radix,
+ * and the runs of strings with the same 8-byte prefix are
+ * then sorted by comparing the whole strings.
+ */
+
+// Entry being sorted: the normalized key of the current
+// pass, and the position of the route in the list.
+typedef struct SortEnt {
+    uint64_t key;
+    int pos;
+} SortEnt;
+
+#define SORT_INS_MAX    16  // max run for the insertion sort
+
+static inline uint8_t sortFoldChar(uint8_t c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? (c + ('a' - 'A')) : c;
+}
+
+// Map a float to an integer with the same order: the sign
+// bit is flipped for the positive values, and all the bits
+// are flipped for the negative values.
+static inline uint64_t sortFloatKey(float val)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &val, sizeof (bits));
+
+    return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+static inline uint64_t sortIntKey(int64_t val)
+{
+    return (uint64_t) val ^ ((uint64_t) 1 << 63);
+}
+
+// The first 8 case-folded bytes of the string, in
+// big-endian order, padded with zeros.
+static uint64_t sortPrefixKey(const JsonStrView *pView)
+{
+    uint64_t key = 0;
+
+    for (int n = 0; n < 8; n++) {
+        key <<= 8;
+        if (n < pView->len)
+            key |= sortFoldChar(pView->str[n]);
+    }
+
+    return key;
+}
+
+// Case-insensitive comparison of the strings
+static int sortStrCmp(const JsonStrView *pView1, const JsonStrView *pView2)
+{
+    size_t len = (pView1->len < pView2->len) ? pView1->len : pView2->len;
+
+    for (size_t n = 0; n < len; n++) {
+        int c1 = sortFoldChar(pView1->str[n]);
+        int c2 = sortFoldChar(pView2->str[n]);
+        if (c1 != c2)
+            return c1 - c2;
+    }
+
+    return (pView1->len > pView2->len) - (pView1->len < pView2->len);
+}
+
+// Stable LSD radix sort of the entries by their key, one byte
+// at a time, skipping the bytes that are the same in all the
+// keys; e.g. a duration key only takes 2 or 3 passes.
+static void sortRadix(SortEnt *ents, SortEnt *tmp, int num)
+{
+    SortEnt *src = ents, *dst = tmp;
+    uint64_t diff = 0;
+
+    for (int n = 1; n < num; n++) {
+        diff |= ents[n].key ^ ents[0].key;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        int count[256] = {0};
+        int off = 0;
+
+        if (((diff >> shift) & 0xff) == 0)
+            continue;
+
+        for (int n = 0; n < num; n++) {
+            count[(src[n].key >> shift) & 0xff]++;
+        }
+        for (int d = 0; d < 256; d++) {
+            int c = count[d];
+            count[d] = off;
+            off += c;
+        }
+        for (int n = 0; n < num; n++) {
+            dst[count[(src[n].key >> shift) & 0xff]++] = src[n];
+        }
+
+        SortEnt *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != ents)
+        memcpy(ents, src, num * sizeof (SortEnt));
+}
+
+// Stable merge sort of a run of entries by the full strings
+static void sortStrRun(SortEnt *ents, SortEnt *tmp, int num, const JsonStrView *strs, int desc)
+{
+    if (num <= SORT_INS_MAX) {
+        for (int i = 1; i < num; i++) {
+            SortEnt ent = ents[i];
+            int j;
+            for (j = i; j > 0; j--) {
+                int cmp = sortStrCmp(&strs[ents[j - 1].pos], &strs[ent.pos]);
+                if ((desc ? -cmp : cmp) <= 0)
+                    break;
+                ents[j] = ents[j - 1];
+            }
+            ents[j] = ent;
+        }
+    } else {
+        int half = num / 2;
+        int n1 = 0, n2 = half, n = 0;
+
+        sortStrRun(ents, tmp, half, strs, desc);
+        sortStrRun(&ents[half], tmp, (num - half), strs, desc);
+
+        while ((n1 < half) && (n2 < num)) {
+            int cmp = sortStrCmp(&strs[ents[n1].pos], &strs[ents[n2].pos]);
+            tmp[n++] = ((desc ? -cmp : cmp) <= 0) ? ents[n1++] : ents[n2++];
+        }
+        while (n1 < half) {
+            tmp[n++] = ents[n1++];
+        }
+        while (n2 < num) {
+            tmp[n++] = ents[n2++];
+        }
+
+        memcpy(ents, tmp, num * sizeof (SortEnt));
+    }
+}
+
+// Get the string key of each route. The country and the
+// province are extracted from the location the same way
+// as in the output, and are copied to the string pool,
+// which grows as needed; so the keys are only pointed
+// into the pool once it's complete.
+static int sortGetStrs(const RouteDB *rtDb, const int *ids, int num, SortFld fld, JsonStrView *strs, char **pPool)
+{
+    char *pool = NULL;
+    size_t poolLen = 0;
+    size_t poolSize = 0;
+
+    for (int n = 0; n < num; n++) {
+        const RouteInfo *pInfo = &rtDb->routes[ids[n]];
+
+        if (fld == sortContributor) {
+            strs[n] = pInfo->contributor;
+        } else if (fld == sortTitle) {
+            strs[n] = pInfo->title;
+        } else {
+            const char *name = (fld == sortCountry) ? fmtCountry(&pInfo->location) : fmtProvince(&pInfo->location);
+            size_t len = strlen(name);
+            if ((poolLen + len) > poolSize) {
+                size_t newSize = (poolSize != 0) ? (poolSize * 2) : ((size_t) num * 16);
+                char *newPool;
+                if (newSize < (poolLen + len))
+                    newSize = poolLen + len;
+                if ((newPool = realloc(pool, newSize)) == NULL) {
+                    fprintf(stderr, "ERROR: failed to alloc sort keys!\n");
+                    free(pool);
+                    return -1;
+                }
+                pool = newPool;
+                poolSize = newSize;
+            }
+            memcpy(&pool[poolLen], name, len);
+            strs[n].len = len;
+            poolLen += len;
+        }
+    }
+
+    if (pool != NULL) {
+        poolLen = 0;
+        for (int n = 0; n < num; n++) {
+            strs[n].str = &pool[poolLen];
+            poolLen += strs[n].len;
+        }
+    }
+
+    *pPool = pool;
+
+    return 0;
+}
+
+// Sort the entries by the key
+static int sortByKey(const RouteDB *rtDb, const int *ids, SortEnt *ents, SortEnt *tmp, int num, const SortKey *pKey)
+{
+    uint64_t mask = pKey->desc ? ~(uint64_t) 0 : 0;
+    JsonStrView *strs = NULL;
+    char *pool = NULL;
+
+    if ((pKey->fld == sortContributor) || (pKey->fld == sortCountry) ||
+        (pKey->fld == sortProvince) || (pKey->fld == sortTitle)) {
+        if (((strs = malloc((num + 1) * sizeof (JsonStrView))) == NULL) ||
+            (sortGetStrs(rtDb, ids, num, pKey->fld, strs, &pool) != 0)) {
+            fprintf(stderr, "ERROR: failed to alloc sort keys!\n");
+            free(strs);
+            return -1;
+        }
+    }
+
+    for (int n = 0; n < num; n++) {
+        int pos = ents[n].pos;
+        int id = ids[pos];
+        uint64_t key;
+
+        switch (pKey->fld) {
+        case sortDistance:
+            key = sortFloatKey(rtDb->distance[id]);
+            break;
+        case sortElevation:
+            key = sortFloatKey(rtDb->elevation[id]);
+            break;
+        case sortDuration:
+            key = sortIntKey(rtDb->duration[id]);
+            break;
+        case sortToughness:
+            key = sortIntKey(rtDb->toughness[id]);
+            break;
+        case sortUpdated:
+            key = sortIntKey(rtDb->updated[id]);
+            break;
+        case sortViews:
+            key = sortIntKey(rtDb->views[id]);
+            break;
+        default:
+            key = sortPrefixKey(&strs[pos]);
+            break;
+        }
+
+        ents[n].key = key ^ mask;
+    }
+
+    sortRadix(ents, tmp, num);
+
+    if (strs != NULL) {
+        // Sort the runs of strings with the same prefix
+        for (int n = 0; n < num; ) {
+            int end = n + 1;
+            while ((end < num) && (ents[end].key == ents[n].key))
+                end++;
+            if ((end - n) > 1)
+                sortStrRun(&ents[n], tmp, (end - n), strs, pKey->desc);
+            n = end;
+        }
+    }
+
+    free(strs);
+    free(pool);
+
+    return 0;
+}
+
+int rtDbSort(RouteDB *rtDb, const SortKey *keys, int numKeys)
+{
+    int num = rtDb->numRoutes;
+    RouteInfo *pRoute;
+    SortEnt *ents = NULL, *tmp = NULL;
+    int *ids = NULL;
+    int s = 0;
+
+    if (((ids = malloc((num + 1) * sizeof (int))) == NULL) ||
+        ((ents = malloc((num + 1) * sizeof (SortEnt))) == NULL) ||
+        ((tmp = malloc((num + 1) * sizeof (SortEnt))) == NULL)) {
+        fprintf(stderr, "ERROR: failed to alloc sort buffers!\n");
+        free(ids);
+        free(ents);
+        return -1;
+    }
+
+    num = 0;
+    TAILQ_FOREACH(pRoute, &rtDb->routeList, tqEntry) {
+        ents[num].pos = num;
+        ids[num++] = pRoute->index;
+    }
+
+    for (int k = (numKeys - 1); (s == 0) && (k >= 0); k--) {
+        s = sortByKey(rtDb, ids, ents, tmp, num, &keys[k]);
+    }
+
+    if (s == 0) {
+        // Relink the list in the sorted order
+        TAILQ_INIT(&rtDb->routeList);
+        for (int n = 0; n < num; n++) {
+            TAILQ_INSERT_TAIL(&rtDb->routeList, &rtDb->routes[ids[ents[n].pos]], tqEntry);
+        }
+    }
+
+    free(ids);
+    free(ents);
+    free(tmp);
+
+    return s;
+}
+
+// Compare the routes by the sort keys; the routes that are
+// equal on all the keys are ordered by their index, so the
+// order is the same as that of the (stable) rtDbSort().
+static int sortCmpRoutes(const RouteDB *rtDb, const SortKey *keys, int numKeys, int id1, int id2)
+{
+    for (int k = 0; k < numKeys; k++) {
+        const SortKey *pKey = &keys[k];
+        uint64_t key1 = 0, key2 = 0;
+        int cmp;
+
+        switch (pKey->fld) {
+        case sortDistance:
+            key1 = sortFloatKey(rtDb->distance[id1]);
+            key2 = sortFloatKey(rtDb->distance[id2]);
+            break;
+        case sortElevation:
+            key1 = sortFloatKey(rtDb->elevation[id1]);
+            key2 = sortFloatKey(rtDb->elevation[id2]);
+            break;
+        case sortDuration:
+            key1 = sortIntKey(rtDb->duration[id1]);
+            key2 = sortIntKey(rtDb->duration[id2]);
+            break;
+        case sortToughness:
+            key1 = sortIntKey(rtDb->toughness[id1]);
+            key2 = sortIntKey(rtDb->toughness[id2]);
+            break;
+        case sortUpdated:
+            key1 = sortIntKey(rtDb->updated[id1]);
+            key2 = sortIntKey(rtDb->updated[id2]);
+            break;
+        case sortViews:
+            key1 = sortIntKey(rtDb->views[id1]);
+            key2 = sortIntKey(rtDb->views[id2]);
+            break;
+        default:
+            break;
+        }
+
+        if (key1 != key2) {
+            cmp = (key1 > key2) ? 1 : -1;
+        } else if (pKey->fld == sortContributor) {
+            cmp = sortStrCmp(&rtDb->routes[id1].contributor, &rtDb->routes[id2].contributor);
+        } else if (pKey->fld == sortTitle) {
+            cmp = sortStrCmp(&rtDb->routes[id1].title, &rtDb->routes[id2].title);
+        } else if ((pKey->fld == sortCountry) || (pKey->fld == sortProvince)) {
+            // The names are returned in a static buffer
+            char name1[128];
+            JsonStrView view1, view2;
+            if (pKey->fld == sortCountry) {
+                snprintf(name1, sizeof (name1), "%s", fmtCountry(&rtDb->routes[id1].location));
+                view2.str = fmtCountry(&rtDb->routes[id2].location);
+            } else {
+                snprintf(name1, sizeof (name1), "%s", fmtProvince(&rtDb->routes[id1].location));
+                view2.str = fmtProvince(&rtDb->routes[id2].location);
+            }
+            view1.str = name1;
+            view1.len = strlen(name1);
+            view2.len = strlen(view2.str);
+            cmp = sortStrCmp(&view1, &view2);
+        } else {
+            cmp = 0;
+        }
+
+        if (cmp != 0)
+            return pKey->desc ? -cmp : cmp;
+    }
+
+    return (id1 > id2) - (id1 < id2);
+}
+
+// Restore the heap property from the top down, in a max-heap
+// of the routes by the sort order.
+static void sortSiftDown(const RouteDB *rtDb, const SortKey *keys, int numKeys, int *heap, int num)
+{
+    int n = 0;
+
+    for (;;) {
+        int child = (2 * n) + 1;
+
+        if (child >= num)
+            break;
+        if (((child + 1) < num) && (sortCmpRoutes(rtDb, keys, numKeys, heap[child + 1], heap[child]) > 0))
+            child++;
+        if (sortCmpRoutes(rtDb, keys, numKeys, heap[child], heap[n]) <= 0)
+            break;
+
+        int swap = heap[n];
+        heap[n] = heap[child];
+        heap[child] = swap;
+        n = child;
+    }
+}
+
+static int sortCmpInt(const void *a, const void *b)
+{
+    int i1 = *(const int *) a;
+    int i2 = *(const int *) b;
+
+    return (i1 > i2) - (i1 < i2);
+}
+
+int rtDbTopK(RouteDB *rtDb, const SortKey *keys, int numKeys, int limit)
+{
+    RouteInfo *pRoute;
+    int *heap;
+    int num = 0;
+
+    if (rtDb->numRoutes <= limit)
+        return rtDbSort(rtDb, keys, numKeys);
+
+    if ((heap = malloc((limit + 1) * sizeof (int))) == NULL) {
+        fprintf(stderr, "ERROR: failed to alloc top-K heap!\n");
+        return -1;
+    }
+
+    // The top of the heap is the last of the routes kept
+    // so far, which is replaced by any route that sorts
+    // before it.
+    TAILQ_FOREACH(pRoute, &rtDb->routeList, tqEntry) {
+        int id = pRoute->index;
+
+        if (num < limit) {
+            int n = num++;
+
+            heap[n] = id;
+            while (n > 0) {
+                int parent = (n - 1) / 2;
+                if (sortCmpRoutes(rtDb, keys, numKeys, heap[n], heap[parent]) <= 0)
+                    break;
+                int swap = heap[n];
+                heap[n] = heap[parent];
+                heap[parent] = swap;
+                n = parent;
+            }
+        } else if ((limit > 0) && (sortCmpRoutes(rtDb, keys, numKeys, id, heap[0]) < 0)) {
+            heap[0] = id;
+            sortSiftDown(rtDb, keys, numKeys, heap, num);
+        }
+    }
+
+    // Relink the survivors in their original order, so
+    // that the stable sort keeps the ties in that order.
+    qsort(heap, num, sizeof (int), sortCmpInt);
+
+    TAILQ_INIT(&rtDb->routeList);
+    for (int n = 0; n < num; n++) {
+        TAILQ_INSERT_TAIL(&rtDb->routeList, &rtDb->routes[heap[n]], tqEntry);
+    }
+    rtDb->numRoutes = num;
+
+    free(heap);
+
+    return rtDbSort(rtDb, keys, numKeys);
+}
+
+void rtDbTruncate(RouteDB *rtDb, int limit)
+{
+    struct RouteList keep = TAILQ_HEAD_INITIALIZER(keep);
+    RouteInfo *pRoute;
+    int num = 0;
+
+    // Move the first routes to a new list, which
+    // then replaces the old one.
+    while ((num < limit) && ((pRoute = TAILQ_FIRST(&rtDb->routeList)) != NULL)) {
+        TAILQ_REMOVE(&rtDb->routeList, pRoute, tqEntry);
+        TAILQ_INSERT_TAIL(&keep, pRoute, tqEntry);
+        num++;
+    }
+
+    TAILQ_INIT(&rtDb->routeList);
+    TAILQ_CONCAT(&rtDb->routeList, &keep, tqEntry);
+    rtDb->numRoutes = num;
+}
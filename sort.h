@@ -0,0 +1,28 @@
+#pragma once
+
+#include <sys/cdefs.h>
+
+#include "args.h"
+#include "routedb.h"
+
+__BEGIN_DECLS
+
+// Sort the list of selected routes by the specified keys, in
+// order of precedence. The routes are sorted as a permutation
+// of their indexes, so the route records are never moved, and
+// then the list is relinked in the sorted order. The sort is
+// stable, so routes with the same keys stay in their original
+// order. Returns 0 on success, or -1 on error.
+extern int rtDbSort(RouteDB *rtDb, const SortKey *keys, int numKeys);
+
+// Keep only the first 'limit' routes of the list of selected
+// routes in the sort order, and sort them. The routes are
+// picked with a bounded heap, so only 'limit' of them are
+// ever held and sorted. Returns 0 on success, or -1 on error.
+extern int rtDbTopK(RouteDB *rtDb, const SortKey *keys, int numKeys, int limit);
+
+// Keep only the first 'limit' routes of the list of selected
+// routes, in their current order.
+extern void rtDbTruncate(RouteDB *rtDb, int limit);
+
+__END_DECLS
@@ -0,0 +1,295 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "strutil.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * The search is done in two steps: the candidate positions
+ * are found by comparing the first and the last byte of s2
+ * against 16 (SSE2) or 32 (AVX2) positions of s1 at a time,
+ * and then each candidate is verified by comparing the whole
+ * string.
+ */
+const char *strFind(const JsonStrView *pView, const char *s2, size_t n2)
+{
+    const char *s1 = pView->str;
+    size_t n1 = pView->len;
+    uint8_t first, last;
+    size_t i = 0;
+
+    if (n2 == 0)
+        return s1;
+    if (n2 > n1)
+        return NULL;
+
+    first = s2[0];
+    last = s2[n2 - 1];
+
+#if defined(__AVX2__)
+    {
+        const __m256i vFirst = _mm256_set1_epi8(first);
+        const __m256i vLast = _mm256_set1_epi8(last);
+
+        for (; (i + n2 - 1 + 32) <= n1; i += 32) {
+            __m256i b1 = _mm256_loadu_si256((const __m256i *) (s1 + i));
+            __m256i b2 = _mm256_loadu_si256((const __m256i *) (s1 + i + n2 - 1));
+            uint32_t cands = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(b1, vFirst), _mm256_cmpeq_epi8(b2, vLast)));
+
+            while (cands != 0) {
+                size_t off = i + __builtin_ctz(cands);
+                if (memcmp((s1 + off), s2, n2) == 0)
+                    return s1 + off;
+                cands &= (cands - 1);
+            }
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    {
+        const __m128i vFirst = _mm_set1_epi8(first);
+        const __m128i vLast = _mm_set1_epi8(last);
+
+        for (; (i + n2 - 1 + 16) <= n1; i += 16) {
+            __m128i b1 = _mm_loadu_si128((const __m128i *) (s1 + i));
+            __m128i b2 = _mm_loadu_si128((const __m128i *) (s1 + i + n2 - 1));
+            uint32_t cands = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(b1, vFirst), _mm_cmpeq_epi8(b2, vLast)));
+
+            while (cands != 0) {
+                size_t off = i + __builtin_ctz(cands);
+                if (memcmp((s1 + off), s2, n2) == 0)
+                    return s1 + off;
+                cands &= (cands - 1);
+            }
+        }
+    }
+#endif
+
+    // Scalar search of the rest of s1, or all of it if
+    // there is no SIMD support
+    for (; (i + n2) <= n1; i++) {
+        if (((uint8_t) s1[i] == first) &&
+            ((uint8_t) s1[i + n2 - 1] == last) &&
+            (memcmp((s1 + i), s2, n2) == 0)) {
+            return s1 + i;
+        }
+    }
+
+    return NULL;
+}
+
+// Base letters of the Latin letters U+00C0 to U+017F, or ""
+// for the ones that are kept as they are.
+static const char strLatinBase[][3] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c",    // U+00C0
+    "e", "e", "e", "e", "i", "i", "i", "i",     // U+00C8
+    "d", "n", "o", "o", "o", "o", "o", "",      // U+00D0
+    "o", "u", "u", "u", "u", "y", "th", "ss",   // U+00D8
+    "a", "a", "a", "a", "a", "a", "ae", "c",    // U+00E0
+    "e", "e", "e", "e", "i", "i", "i", "i",     // U+00E8
+    "d", "n", "o", "o", "o", "o", "o", "",      // U+00F0
+    "o", "u", "u", "u", "u", "y", "th", "y",    // U+00F8
+    "a", "a", "a", "a", "a", "a", "c", "c",     // U+0100
+    "c", "c", "c", "c", "c", "c", "d", "d",     // U+0108
+    "d", "d", "e", "e", "e", "e", "e", "e",     // U+0110
+    "e", "e", "e", "e", "g", "g", "g", "g",     // U+0118
+    "g", "g", "g", "g", "h", "h", "h", "h",     // U+0120
+    "i", "i", "i", "i", "i", "i", "i", "i",     // U+0128
+    "i", "i", "ij", "ij", "j", "j", "k", "k",   // U+0130
+    "k", "l", "l", "l", "l", "l", "l", "l",     // U+0138
+    "l", "l", "l", "n", "n", "n", "n", "n",     // U+0140
+    "n", "n", "n", "n", "o", "o", "o", "o",     // U+0148
+    "o", "o", "oe", "oe", "r", "r", "r", "r",   // U+0150
+    "r", "r", "s", "s", "s", "s", "s", "s",     // U+0158
+    "s", "s", "t", "t", "t", "t", "t", "t",     // U+0160
+    "u", "u", "u", "u", "u", "u", "u", "u",     // U+0168
+    "u", "u", "u", "u", "w", "w", "y", "y",     // U+0170
+    "y", "z", "z", "z", "z", "z", "z", "s",     // U+0178
+};
+
+#define STR_LATIN_FIRST     0x00C0
+#define STR_LATIN_LAST      0x017F
+
+_Static_assert((sizeof (strLatinBase) / sizeof (strLatinBase[0])) == (STR_LATIN_LAST - STR_LATIN_FIRST + 1),
+               "Missing Latin letters in strLatinBase!");
+
+// Append the UTF-8 encoding of the code point to 'dst'
+static char *strPutCp(char *dst, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *dst++ = cp;
+    } else if (cp < 0x800) {
+        *dst++ = 0xC0 | (cp >> 6);
+        *dst++ = 0x80 | (cp & 0x3F);
+    } else if (cp < 0x10000) {
+        *dst++ = 0xE0 | (cp >> 12);
+        *dst++ = 0x80 | ((cp >> 6) & 0x3F);
+        *dst++ = 0x80 | (cp & 0x3F);
+    } else {
+        *dst++ = 0xF0 | (cp >> 18);
+        *dst++ = 0x80 | ((cp >> 12) & 0x3F);
+        *dst++ = 0x80 | ((cp >> 6) & 0x3F);
+        *dst++ = 0x80 | (cp & 0x3F);
+    }
+
+    return dst;
+}
+
+// Append the normalized code point to 'dst'
+static char *strFoldCp(char *dst, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *dst++ = ((cp >= 'A') && (cp <= 'Z')) ? (cp + ('a' - 'A')) : cp;
+    } else if ((cp >= 0x0300) && (cp <= 0x036F)) {
+        // Combining accent: dropped
+    } else if ((cp >= STR_LATIN_FIRST) && (cp <= STR_LATIN_LAST) && (strLatinBase[cp - STR_LATIN_FIRST][0] != '\0')) {
+        const char *base = strLatinBase[cp - STR_LATIN_FIRST];
+        *dst++ = base[0];
+        if (base[1] != '\0')
+            *dst++ = base[1];
+    } else {
+        dst = strPutCp(dst, cp);
+    }
+
+    return dst;
+}
+
+// Parse the 4 hex digits of a \u escape sequence
+static int strParseHex4(const char *p, uint32_t *pVal)
+{
+    uint32_t val = 0;
+
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        if ((c >= '0') && (c <= '9')) {
+            val = (val << 4) | (c - '0');
+        } else if (((c | 0x20) >= 'a') && ((c | 0x20) <= 'f')) {
+            val = (val << 4) | ((c | 0x20) - 'a' + 10);
+        } else {
+            return -1;
+        }
+    }
+
+    *pVal = val;
+
+    return 0;
+}
+
+// Decode the JSON escape sequence at 'p' into a code point.
+// Returns the length of the sequence, or 0 if it's invalid.
+static size_t strDecodeEsc(const char *p, const char *end, uint32_t *pCp)
+{
+    static const char escChars[] = "\"\\/bfnrt";
+    static const char escVals[] = "\"\\/\b\f\n\r\t";
+    const char *c;
+    uint32_t lo;
+
+    if ((end - p) < 2)
+        return 0;
+
+    if ((p[1] != 'u') && (p[1] != '\0') && ((c = strchr(escChars, p[1])) != NULL)) {
+        *pCp = (uint8_t) escVals[c - escChars];
+        return 2;
+    }
+
+    if ((p[1] != 'u') || ((end - p) < 6) || (strParseHex4(&p[2], pCp) != 0))
+        return 0;
+
+    // A surrogate pair takes two escape sequences
+    if ((*pCp >= 0xD800) && (*pCp <= 0xDBFF) &&
+        ((end - p) >= 12) && (p[6] == '\\') && (p[7] == 'u') &&
+        (strParseHex4(&p[8], &lo) == 0) && (lo >= 0xDC00) && (lo <= 0xDFFF)) {
+        *pCp = 0x10000 + ((*pCp - 0xD800) << 10) + (lo - 0xDC00);
+        return 12;
+    }
+
+    return 6;
+}
+
+#define STR_ONES    0x0101010101010101ULL
+#define STR_HIGHS   0x8080808080808080ULL
+
+// Each sequence of the source is consumed before its result
+// is stored, and the result is never longer than the sequence,
+// so the normalization can be done in place. The plain ASCII
+// text, which is most of it, is folded 8 bytes at a time.
+size_t strNorm(const char *src, size_t len, int json, char *dst)
+{
+    const char *end = src + len;
+    char *start = dst;
+
+    while (src < end) {
+        uint8_t c = *src;
+        uint32_t cp;
+        size_t n;
+
+        if ((end - src) >= 8) {
+            uint64_t word, bs;
+
+            memcpy(&word, src, 8);
+            bs = word ^ (STR_ONES * '\\');
+            if (((word & STR_HIGHS) == 0) && (!json || (((bs - STR_ONES) & ~bs & STR_HIGHS) == 0))) {
+                // The high bit of each byte of 'ge' is set if
+                // the byte is >= 'A', and that of 'gt' if it's
+                // > 'Z'; the bytes are ASCII, so the sums don't
+                // carry into the next byte.
+                uint64_t ge = word + (STR_ONES * (0x80 - 'A'));
+                uint64_t gt = word + (STR_ONES * (0x80 - 'Z' - 1));
+                word |= ((ge & ~gt) & STR_HIGHS) >> 2;
+                memcpy(dst, &word, 8);
+                src += 8;
+                dst += 8;
+                continue;
+            }
+        }
+
+        if (c < 0x80) {
+            if (json && (c == '\\') && ((n = strDecodeEsc(src, end, &cp)) != 0)) {
+                src += n;
+                dst = strFoldCp(dst, cp);
+            } else {
+                src++;
+                *dst++ = ((c >= 'A') && (c <= 'Z')) ? (c + ('a' - 'A')) : c;
+            }
+        } else if ((c >= 0xC2) && (c <= 0xDF) && ((src + 1) < end) && ((src[1] & 0xC0) == 0x80)) {
+            // 2-byte UTF-8 sequence, which covers all the
+            // Latin letters and the combining accents
+            cp = ((c & 0x1F) << 6) | (src[1] & 0x3F);
+            src += 2;
+            dst = strFoldCp(dst, cp);
+        } else {
+            // Anything else is kept as it is
+            *dst++ = *src++;
+        }
+    }
+
+    return dst - start;
+}
+
+// The encoding of a code point is never longer than its
+// escape sequence, so the decoding can be done in place.
+size_t strUnescape(const char *src, size_t len, char *dst)
+{
+    const char *end = src + len;
+    char *start = dst;
+
+    while (src < end) {
+        uint32_t cp;
+        size_t n;
+
+        if ((*src == '\\') && ((n = strDecodeEsc(src, end, &cp)) != 0)) {
+            src += n;
+            dst = strPutCp(dst, cp);
+        } else {
+            *dst++ = *src++;
+        }
+    }
+
+    return dst - start;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json.h"
+
+__BEGIN_DECLS
+
+// Normalize the string for the liberal match: the ASCII letters
+// are folded to lower case, the Latin letters (U+00C0 to U+017F)
+// are folded to their base letters without the accents, as with
+// the NFKD decomposition (e.g. "Ü" becomes "u", and "Æ" becomes
+// "ae"), and the combining accents are dropped. If 'json' is set,
+// the JSON escape sequences are decoded first. The result, which
+// is never longer than the string, is stored in 'dst', which can
+// be the string itself. Returns the length of the result.
+extern size_t strNorm(const char *src, size_t len, int json, char *dst);
+
+// Decode the JSON escape sequences of the string, without any
+// other change. The result, which is never longer than the
+// string, is stored in 'dst', which can be the string itself.
+// Returns the length of the result.
+extern size_t strUnescape(const char *src, size_t len, char *dst);
+
+// Search of the first n2 characters of s2 in a string view.
+// It's used to search the normalized query in the normalized
+// fields (see strNorm()), which only needs an exact match.
+extern const char *strFind(const JsonStrView *pView, const char *s2, size_t n2);
+
+__END_DECLS